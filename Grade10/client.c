@@ -1,58 +1,49 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdio.h>
-#include <sys/sem.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/io.h"
+#include "../common/protocol.h"
+#include "../common/stats.h"
 
-#define SINGLE_ROOMS_COUNT 10
-#define DOUBLE_ROOMS_COUNT 15
 #define ROOMS_INPUT_NAME "/tmp/rooms_input23102"
-#define ROOMS_OUTPUT_NAME "/tmp/rooms_output23102"
-#define ROOMS_SEM_NAME "/rooms_sem18200345678"
-
-// Статус комнаты.
-typedef enum {
-    freed,
-    busied_by_man,
-    busied_by_woman,
-    full
-} room_status;
-
-// Структура с данными о состоянии комнат.
-typedef struct {
-    room_status single_rooms[SINGLE_ROOMS_COUNT];
-    room_status double_rooms[DOUBLE_ROOMS_COUNT];
-} rooms_data_t;
-
-// Структура с данными сообщения
-typedef struct {
-    int packet_id;
-    rooms_data_t data;
-} message_t;
-
-// Ожидает разблокировки семафора.
-void wait_semaphore(int sem_id) {
-    struct sembuf sem_op;
-    sem_op.sem_num = 0;
-    sem_op.sem_op = 0;
-    sem_op.sem_flg = 0;
-    semop(sem_id, &sem_op, 1);
-    semctl(sem_id, 0, SETVAL, 1);
-}
+#define ROOMS_REPLY_NAME "/tmp/rooms_reply23102_%d"
+#define ROOMS_STATS_NAME "/rooms_stats23102"
 
 // Общие переменные для работы программы.
 int rooms_input_fd;
-int rooms_output_fd;
-int rooms_semaphore_id;
-rooms_data_t *rooms_data;
+int rooms_reply_fd;
+char rooms_reply_name[64];
+// Счетчики работы отеля или NULL, если отель их не выставил.
+hotel_stats_stripes_t *stats;
+
+// Отправляет отелю запрос и читает ответ из собственного канала клиента.
+// Ответы разным клиентам не смешиваются, поэтому блокировать других клиентов на время обмена не нужно.
+// Время обмена попадает в статистику отеля.
+void send_request(const hotel_request_t *request, hotel_reply_t *reply) {
+    uint64_t started_at = stats_now_ns();
+    write_full(rooms_input_fd, request, sizeof(hotel_request_t));
+    read_full(rooms_reply_fd, reply, sizeof(hotel_reply_t));
+
+    if (stats != NULL) {
+        stats_record(&stats_stripe(stats, (uint32_t) getpid())->round_trip, started_at);
+    }
+}
 
 // Освобождает занятые процессом ресурсы.
 void free_resources() {
-    semctl(rooms_semaphore_id, 0, IPC_RMID, 0);
-    close(rooms_output_fd);
+    if (stats != NULL) {
+        munmap(stats, sizeof(hotel_stats_stripes_t));
+    }
+
+    close(rooms_reply_fd);
+    unlink(rooms_reply_name);
     close(rooms_input_fd);
-    free(rooms_data);
     exit(1);
 }
 
@@ -67,115 +58,42 @@ int main(__attribute__((unused)) int argc, char *argv[]) {
     int client_id = atoi(argv[1]);
     int client_gender = atoi(argv[2]);
     int client_rent_time = atoi(argv[3]);
-    key_t sem_key = ftok("/tmp", 0x18200456);
 
-    // Инициализируем семафоры и сокеты.
-    rooms_semaphore_id = semget(sem_key, 1, IPC_CREAT | 0666);
+    // Инициализируем каналы.
     rooms_input_fd = open(ROOMS_INPUT_NAME, O_RDWR);
-    rooms_output_fd = open(ROOMS_OUTPUT_NAME, O_RDWR);
-    rooms_data = malloc(sizeof(rooms_data_t));
-    signal(SIGTERM, handle_sigterm);
 
-    // Ищем свободную комнату, перед этим блокируем семафор.
-    wait_semaphore(rooms_semaphore_id);
-
-    // Запрашиваем у отеля состояние его комнат.
-    message_t get_state_msg;
-    get_state_msg.packet_id = 1;
-    write(rooms_input_fd, &get_state_msg, sizeof(message_t));
-    read(rooms_output_fd, rooms_data, sizeof(rooms_data_t));
-
-    // Теперь поищем нужный нам отель!
-    // Сначала проверим комнаты на одно спальное место.
-    int used_single_idx = -1;
-    int used_double_idx = -1;
-
-    for (int i = 0; i < SINGLE_ROOMS_COUNT; ++i) {
-        if (rooms_data->single_rooms[i] == freed) {
-            printf("[CLIENT-%d] rent single room: idx = %li.\n", client_id, i);
-            rooms_data->single_rooms[i] = full;
-            used_single_idx = i;
-            break;
-        }
-    }
+    // Канал для ответов создается до первого запроса, чтобы отелю было куда писать.
+    snprintf(rooms_reply_name, sizeof(rooms_reply_name), ROOMS_REPLY_NAME, getpid());
+    mkfifo(rooms_reply_name, 0666);
+    rooms_reply_fd = open(rooms_reply_name, O_RDWR);
 
-    // Если же не нашли на одно место, то поищем на два места, но при условии, либо комната пуста,
-    // либо в ней живет человек того же пола.
-    if (used_single_idx == -1) {
-        for (int i = 0; i < DOUBLE_ROOMS_COUNT; ++i) {
-            if (rooms_data->double_rooms[i] == freed) {
-                rooms_data->double_rooms[i] = client_gender == 0 ? busied_by_man : busied_by_woman;
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d.\n", client_id, i, client_gender);
-                used_double_idx = i;
-                break;
-            } else if ((rooms_data->double_rooms[i] == busied_by_man && client_gender == 0) ||
-                       (rooms_data->double_rooms[i] == busied_by_woman && client_gender == 1)) {
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d, with_gender = %d.\n", client_id, i,
-                       client_gender, client_gender);
-
-                rooms_data->double_rooms[i] = full;
-                used_double_idx = i;
-                break;
-            }
-        }
+    int stats_fd = shm_open(ROOMS_STATS_NAME, O_RDWR, 0666);
+    if (stats_fd != -1) {
+        stats = mmap(NULL, sizeof(hotel_stats_stripes_t), PROT_READ | PROT_WRITE, MAP_SHARED, stats_fd, 0);
+        stats = stats == MAP_FAILED ? NULL : stats;
+        close(stats_fd);
     }
+    signal(SIGTERM, handle_sigterm);
 
-    message_t set_state_msg;
-    set_state_msg.packet_id = 2;
-    for (int i = 0; i < SINGLE_ROOMS_COUNT; ++i) {
-        set_state_msg.data.single_rooms[i] = rooms_data->single_rooms[i];
-    }
-    for (int i = 0; i < DOUBLE_ROOMS_COUNT; ++i) {
-        set_state_msg.data.double_rooms[i] = rooms_data->double_rooms[i];
-    }
-
-    write(rooms_input_fd, &set_state_msg, sizeof(message_t));
-    read(rooms_output_fd, rooms_data, sizeof(rooms_data_t));
-
-    // Разблокируем семафор, чтобы другой процесс забронировал комнату.
-    semctl(rooms_semaphore_id, 0, SETVAL, 0);
+    // Просим отель подобрать номер: сначала одноместный, затем двухместный - пустой или с соседом того же пола.
+    hotel_request_t request = {packet_book, client_id, getpid(), client_gender, 0, -1, client_rent_time};
+    hotel_reply_t reply;
+    send_request(&request, &reply);
 
-    // Если нашли комнату, то значит, что статус мы изменили.
-    if (used_double_idx == -1 && used_single_idx == -1) {
-        printf("[CLIENT-%d] out of service!\n", client_id);
+    // Строки журнала о заселении, отказе и выезде печатает отель: он видит результат каждого запроса.
+    if (reply.result == -1) {
         free_resources();
         return 0;
     }
 
-    // Бронируем комнату и ждем ...
-    printf("[CLIENT-%d] waiting %ds.\n", client_id, client_rent_time);
-    sleep(client_rent_time);
-
-    // Теперь освободим комнату.
-    wait_semaphore(rooms_semaphore_id);
-
-    // Запрашиваем у отеля состояние его комнат.
-    write(rooms_input_fd, &get_state_msg, sizeof(message_t));
-    read(rooms_output_fd, rooms_data, sizeof(rooms_data_t));
-
-    if (used_double_idx >= 0) {
-        if (rooms_data->double_rooms[used_double_idx] == full) {
-            rooms_data->double_rooms[used_double_idx] = client_gender == 0 ? busied_by_man : busied_by_woman;
-        } else if (rooms_data->double_rooms[used_double_idx] == busied_by_man ||
-                   rooms_data->double_rooms[used_double_idx] == busied_by_woman) {
-            rooms_data->double_rooms[used_double_idx] = freed;
-        }
-    } else if (used_single_idx >= 0) {
-        rooms_data->single_rooms[used_single_idx] = freed;
+    // Номер освободит сам отель по истечении срока аренды, поэтому ждать его клиенту не нужно.
+    // Нулевой срок в запросе означает бронирование без срока, поэтому такой номер клиент освобождает сам.
+    if (client_rent_time == 0) {
+        hotel_request_t release = {packet_release, client_id, getpid(), client_gender, reply.is_double,
+                                   reply.room_idx, 0};
+        write_full(rooms_input_fd, &release, sizeof(hotel_request_t));
     }
 
-    for (int i = 0; i < SINGLE_ROOMS_COUNT; ++i) {
-        set_state_msg.data.single_rooms[i] = rooms_data->single_rooms[i];
-    }
-    for (int i = 0; i < DOUBLE_ROOMS_COUNT; ++i) {
-        set_state_msg.data.double_rooms[i] = rooms_data->double_rooms[i];
-    }
-
-    write(rooms_input_fd, &set_state_msg, sizeof(message_t));
-    read(rooms_output_fd, rooms_data, sizeof(rooms_data_t));
-
-    printf("[CLIENT-%d] end of rent!\n", client_id);
-    semctl(rooms_semaphore_id, 0, SETVAL, 0);
     free_resources();
     return 0;
 }
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -7,114 +8,163 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+
+#include "../common/client_ring.h"
+#include "../common/clients.h"
+#include "../common/hotel_checkouts.h"
+#include "../common/rooms_segment.h"
 
-#define SINGLE_ROOMS_COUNT 10
-#define DOUBLE_ROOMS_COUNT 15
 #define ROOMS_MEM_NAME "/rooms_mem"
+// Префикс имен семафоров шардов: семафор шарда i называется "/rooms_sem223431_i".
 #define ROOMS_SEM_NAME "/rooms_sem223431"
-#define CURRENT_CLIENT_WAIT_SEM_NAME "/current_client_wait_sem_hw2223323"
-
-// Статус комнаты.
-typedef enum {
-    freed,
-    busied_by_man,
-    busied_by_woman,
-    full
-} room_status;
+#define CLIENT_SLOTS_FREE_SEM_NAME "/client_slots_free_sem_hw2223323"
+#define CLIENT_SLOTS_USED_SEM_NAME "/client_slots_used_sem_hw2223323"
 
 // Структура с данными о состоянии комнат.
 typedef struct {
-    room_status single_rooms[SINGLE_ROOMS_COUNT];
-    room_status double_rooms[DOUBLE_ROOMS_COUNT];
-    // Данные клиента запускаемого в данный момент процесса.
-    int current_client_id;
-    int current_client_gender;
-    int current_client_rent_time;
+    // Записи клиентов, которые отель передает запускаемым процессам.
+    client_ring_t clients;
+    // Заголовок состояния комнат, массивы номеров лежат в этой же памяти сразу за ним.
+    rooms_header_t rooms;
 } rooms_data_t;
 
 // Обрабатывает логику клиента отеля.
-void handle_client_process(rooms_data_t *data, sem_t *rooms_semaphore, sem_t *current_client_wait_sem) {
-    int client_id = data->current_client_id;
-    int client_gender = data->current_client_gender;
-    int client_rent_time = data->current_client_rent_time;
-    printf("[CLIENT-%d] started.\n", client_id);
-    sem_post(current_client_wait_sem);
-
-    // Ищем свободную комнату, перед этим блокируем семафор.
-    sem_wait(rooms_semaphore);
-
-    // Сначала проверим комнаты на одно спальное место.
-    int used_single_idx = -1;
-    int used_double_idx = -1;
-
-    for (int i = 0; i < SINGLE_ROOMS_COUNT; ++i) {
-        if (data->single_rooms[i] == freed) {
-            printf("[CLIENT-%d] rent single room: idx = %li.\n", client_id, i);
-            data->single_rooms[i] = full;
-            used_single_idx = i;
-            break;
-        }
+void handle_client(rooms_data_t *data, int client_id, int client_gender, int client_rent_time) {
+    hotel_stats_t *stats = rooms_segment_stats(&data->rooms);
+    // События клиента записываются в кольцо журнала в сегменте, а строки из них выводит отель.
+    event_log_t *log = rooms_segment_log(&data->rooms);
+    event_log_write(log, log_client_started, client_id, 0, 0);
+
+    // Ищем свободную комнату: сначала в шарде клиента, затем в соседних. Сначала проверяются комнаты на одно
+    // спальное место, затем на два, но при условии, что комната пуста или в ней живет человек того же пола.
+    // Каждый шард на время поиска блокируется своим именованным семафором, поэтому клиенты из разных шардов не ждут
+    // друг друга. Шарды, в которых по счетчикам номеров мест нет, пропускаются, не дожидаясь их семафоров.
+    // Время ожидания и удержания семафоров попадает в статистику отеля.
+    rooms_booking_t booking;
+    rooms_waiter_t *waiter = NULL;
+    int booked = rooms_waitlist_book(&data->rooms, client_id, client_gender, 1, &booking, &waiter);
+
+    // Если мест нет, клиент встает в лист ожидания (если он включен) и спит, пока отель не забронирует ему
+    // освободившийся номер.
+    if (booked == 1) {
+        event_log_write(log, log_client_waiting_room, client_id, 0, 0);
+        stats_count(&stats->waitlisted);
+        uint64_t wait_started_at = stats_now_ns();
+        booked = rooms_waitlist_wait(waiter, &booking);
+        stats_record(&stats->waitlist_wait, wait_started_at);
     }
 
-    // Если же не нашли на одно место, то поищем на два места, но при условии, либо комната пуста,
-    // либо в ней живет человек того же пола.
-    if (used_single_idx == -1) {
-        for (int i = 0; i < DOUBLE_ROOMS_COUNT; ++i) {
-            if (data->double_rooms[i] == freed) {
-                data->double_rooms[i] = client_gender == 0 ? busied_by_man : busied_by_woman;
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d.\n", client_id, i, client_gender);
-                used_double_idx = i;
-                break;
-            } else if ((data->double_rooms[i] == busied_by_man && client_gender == 0) ||
-                       (data->double_rooms[i] == busied_by_woman && client_gender == 1)) {
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d, with_gender = %d.\n", client_id, i,
-                       client_gender, client_gender);
-
-                data->double_rooms[i] = full;
-                used_double_idx = i;
-                break;
-            }
+    // Отказ клиенту из листа ожидания записывает в журнал отель, закрывая лист.
+    if (booked == -1) {
+        if (waiter == NULL) {
+            event_log_write(log, log_client_out_of_service, client_id, 0, 0);
         }
+        stats_count(&stats->rejected);
+        return;
     }
 
-    // Разблокируем семафор, чтобы другой процесс забронировал комнату.
-    sem_post(rooms_semaphore);
-
-    // Если нашли комнату, то значит, что статус мы изменили.
-    if (used_double_idx == -1 && used_single_idx == -1) {
-        printf("[CLIENT-%d] out of service!\n", client_id);
-        return;
+    int room_idx = rooms_booking_room(&data->rooms, &booking);
+    if (!booking.is_double) {
+        event_log_write(log, log_client_rent_single, client_id, room_idx, 0);
+    } else if (booking.previous_status == freed) {
+        event_log_write(log, log_client_rent_double, client_id, room_idx, client_gender);
+    } else {
+        event_log_write(log, log_client_rent_double_shared, client_id, room_idx, client_gender);
     }
 
     // Бронируем комнату и ждем ...
-    printf("[CLIENT-%d] waiting %ds.\n", client_id, client_rent_time);
-    sleep(client_rent_time);
-
-    // Теперь освободим комнату.
-    sem_wait(rooms_semaphore);
-
-    if (used_double_idx >= 0) {
-        if (data->double_rooms[used_double_idx] == full) {
-            data->double_rooms[used_double_idx] = client_gender == 0 ? busied_by_man : busied_by_woman;
-        } else if (data->double_rooms[used_double_idx] == busied_by_man ||
-                   data->double_rooms[used_double_idx] == busied_by_woman) {
-            data->double_rooms[used_double_idx] = freed;
-        }
-    } else if (used_single_idx >= 0) {
-        data->single_rooms[used_single_idx] = freed;
+    stats_count(&stats->booked);
+    event_log_write(log, log_client_waiting_rent, client_id, client_rent_time, 0);
+    rooms_checkout_t checkout = {stats_now_ns() + (uint64_t) client_rent_time * 1000000000, client_id, client_gender,
+                                 booking};
+
+    // Номер по окончании аренды освобождает поток выездов отеля, а клиент сразу уходит: дочерний процесс
+    // завершается, поток пула переходит к следующему клиенту. Аренда нулевой длины уже закончилась, и номер
+    // освобождается сразу: иначе следующие клиенты успели бы получить отказ, пока выезд лежит в очереди.
+    if (client_rent_time == 0) {
+        hotel_checkouts_release(&data->rooms, &checkout);
+        return;
     }
 
-    printf("[CLIENT-%d] end of rent!\n", client_id);
-    sem_post(rooms_semaphore);
+    rooms_checkouts_push(&data->rooms, &checkout);
+}
+
+// Забирает запись клиента из кольцевого буфера в shared memory и обрабатывает его логику в дочернем процессе.
+void handle_client_process(rooms_data_t *data, sem_t *client_slots_free_sem, sem_t *client_slots_used_sem) {
+    client_record_t record;
+    sem_wait(client_slots_used_sem);
+    client_ring_pop(&data->clients, &record);
+    sem_post(client_slots_free_sem);
+    handle_client(data, record.id, record.gender, record.rent_time);
 }
 
 // Общие переменные для работы программы.
 int rooms_fd;
 bool is_child_process;
-FILE *client_file;
+// Записи всех клиентов, загруженные до начала моделирования, и индекс следующей записи для пула потоков.
+clients_trace_t clients;
+int next_client_record;
 rooms_data_t *rooms_data;
-sem_t *current_client_wait_sem;
-sem_t *rooms_semaphore;
+size_t rooms_data_size;
+// Фоновый писатель журнала клиентов в процессе отеля.
+event_log_writer_t log_writer;
+// Поток выездов отеля, освобождающий номера по окончании аренды.
+hotel_checkouts_t checkouts;
+// Выставляется обработчиком SIGUSR1, статистику печатают циклы отеля.
+volatile sig_atomic_t stats_requested;
+sem_t *client_slots_free_sem;
+sem_t *client_slots_used_sem;
+// Именованные семафоры шардов, по одному на шард.
+sem_t **rooms_semaphores;
+int rooms_semaphores_count;
+
+// Печатает статистику отеля, если ее запросили сигналом SIGUSR1. Печатать в самом обработчике нельзя: сигнал
+// может прийти, пока процесс уже выводит строку и держит блокировку stdout.
+void print_requested_stats() {
+    if (!is_child_process && __atomic_exchange_n(&stats_requested, 0, __ATOMIC_RELAXED)) {
+        stats_print_stripes(stdout, &rooms_data->rooms.stats);
+    }
+}
+
+// Обслуживает клиентов из общего массива записей, пока они не закончатся. Статистику по SIGUSR1 печатают сами
+// потоки пула между клиентами: основной поток в это время ждет их завершения.
+void *handle_worker_thread(__attribute__((unused)) void *arg) {
+    int idx;
+
+    while ((idx = __atomic_fetch_add(&next_client_record, 1, __ATOMIC_RELAXED)) < clients.count) {
+        print_requested_stats();
+        client_record_t record;
+        clients_get(&clients, idx, &record);
+        handle_client(rooms_data, record.id, record.gender, record.rent_time);
+    }
+
+    return NULL;
+}
+
+// Обслуживает всех клиентов пулом из threads_count потоков внутри текущего процесса.
+void run_worker_threads(int threads_count) {
+    pthread_t *threads = malloc(sizeof(pthread_t) * threads_count);
+    sigset_t signals, previous_signals;
+
+    // Потоки наследуют маску сигналов: SIGUSR1 обрабатывает только основной поток, чтобы сигнал
+    // не прервал ожидание семафора в обслуживающем потоке.
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+
+    for (int i = 0; i < threads_count; ++i) {
+        pthread_create(&threads[i], NULL, handle_worker_thread, NULL);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+
+    for (int i = 0; i < threads_count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+}
 
 // Освобождает занятые процессом ресурсы.
 void free_resources() {
@@ -122,25 +172,38 @@ void free_resources() {
     while (wait(NULL) > 0) {
     }
 
+    // Останавливаем поток выездов, если он еще работает, выводим журнал клиентов до конца и останавливаем его
+    // писателя.
+    if (!is_child_process) {
+        hotel_checkouts_stop(&checkouts, 0);
+        event_log_writer_stop(&log_writer);
+    }
+
     // Освобождаем ресурсы.
-    fclose(client_file);
-    sem_close(rooms_semaphore);
+    clients_free(&clients);
 
-    if (!is_child_process) {
-        sem_unlink(ROOMS_SEM_NAME);
+    // Именованный семафор не уничтожается через sem_destroy: его закрывает каждый процесс, а удаляет только отель.
+    for (int i = 0; i < rooms_semaphores_count; ++i) {
+        sem_close(rooms_semaphores[i]);
+
+        if (!is_child_process) {
+            char name[64];
+            snprintf(name, sizeof(name), "%s_%d", ROOMS_SEM_NAME, i);
+            sem_unlink(name);
+        }
     }
+    free(rooms_semaphores);
 
-    sem_destroy(rooms_semaphore);
-    sem_close(current_client_wait_sem);
+    sem_close(client_slots_free_sem);
+    sem_close(client_slots_used_sem);
 
     if (!is_child_process) {
-        sem_unlink(CURRENT_CLIENT_WAIT_SEM_NAME);
+        sem_unlink(CLIENT_SLOTS_FREE_SEM_NAME);
+        sem_unlink(CLIENT_SLOTS_USED_SEM_NAME);
     }
 
-    sem_destroy(current_client_wait_sem);
-
     if (!is_child_process) {
-        munmap(rooms_data, sizeof(rooms_data_t));
+        munmap(rooms_data, rooms_data_size);
         shm_unlink(ROOMS_MEM_NAME);
     }
 
@@ -149,12 +212,57 @@ void free_resources() {
 
 // Обрабатывает сигнал завершения программы.
 void handle_sigterm(__attribute__((unused)) int signal) {
+    // Отель будит клиентов из листа ожидания, иначе он не дождется их завершения.
+    if (!is_child_process) {
+        rooms_waitlist_close(&rooms_data->rooms);
+    }
+
     free_resources();
 }
 
-int main() {
+// Запрашивает печать статистики по сигналу SIGUSR1: kill -USR1 <pid>.
+void handle_sigusr1(__attribute__((unused)) int signal) {
+    stats_requested = 1;
+}
+
+// Дожидается, пока поток выездов не освободит номера всех гостей, и завершает отель. Клиенты к этому моменту уже
+// поручили все выезды. Статистика печатается по каждому SIGUSR1.
+void wait_checkouts() {
+    hotel_checkouts_finish(&checkouts);
+    while (hotel_checkouts_wait(&checkouts) == -1) {
+        print_requested_stats();
+    }
+
+    free_resources();
+}
+
+int main(int argc, char *argv[]) {
     is_child_process = false;
 
+    // Строки журнала выводятся сразу, даже если вывод перенаправлен в канал, как в терминале.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Число номеров задается аргументами или файлом конфигурации.
+    rooms_config_t config;
+    if (rooms_config_parse(&config, argc, argv) == -1) {
+        return 1;
+    }
+
+    // Номера освобождает поток выездов отеля, которому клиенты передают выезды через очередь в сегменте. Поэтому
+    // поток пула, ожидающий в листе, не мешает освобождать номера, и лист ожидания работает одинаково с процессом
+    // на каждого клиента и с пулом потоков.
+    config.hotel_checkouts = 1;
+
+    // Загружаем всех клиентов до начала моделирования: кольцо журнала в сегменте рассчитывается на их события.
+    if (clients_load(&clients, config.clients_path) == -1) {
+        perror("clients_load");
+        return 1;
+    }
+
+    rooms_config_log_clients(&config, clients.count);
+    rooms_data_size = offsetof(rooms_data_t, rooms) +
+                      rooms_segment_size(&config);
+
     // Инициализируем доступ к shared memory для работы с состояниями комнат.
     rooms_fd = shm_open(ROOMS_MEM_NAME, O_RDWR | O_CREAT, 0666);
     if (rooms_fd == -1) {
@@ -162,48 +270,97 @@ int main() {
         return 1;
     }
 
-    if (ftruncate(rooms_fd, sizeof(rooms_data_t)) == -1) {
+    if (ftruncate(rooms_fd, rooms_data_size) == -1) {
         perror("ftruncate(rooms_fd) == -1");
         return 1;
     }
 
-    rooms_data = mmap(NULL, sizeof(rooms_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, rooms_fd, 0);
+    rooms_data = mmap(NULL, rooms_data_size, PROT_READ | PROT_WRITE, MAP_SHARED, rooms_fd, 0);
     if (rooms_data == MAP_FAILED) {
         perror("rooms_data == MAP_FAILED");
         return 1;
     }
 
     // Инициализируем состояние комнат.
-    memset(rooms_data->single_rooms, freed, sizeof(room_status) * SINGLE_ROOMS_COUNT);
-    memset(rooms_data->double_rooms, freed, sizeof(room_status) * DOUBLE_ROOMS_COUNT);
+    rooms_segment_init(&rooms_data->rooms, &config);
+    client_ring_init(&rooms_data->clients);
+
+    // Открываем семафоры для первичной инициализации: по семафору на каждый шард номеров. Семафоры, оставшиеся от
+    // аварийно завершенного запуска, сначала удаляются.
+    rooms_semaphores_count = rooms_data->rooms.shards_count;
+    rooms_semaphores = malloc(sizeof(sem_t *) * rooms_semaphores_count);
+    for (int i = 0; i < rooms_semaphores_count; ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s_%d", ROOMS_SEM_NAME, i);
+        sem_unlink(name);
+        rooms_semaphores[i] = sem_open(name, O_CREAT | O_EXCL, 0644, 1);
+        if (rooms_semaphores[i] == SEM_FAILED) {
+            perror(name);
+            return 1;
+        }
+    }
+    rooms_segment_use_posix_locks(&rooms_data->rooms, rooms_semaphores);
 
-    // Открываем семафоры для первичной инициализации.
-    rooms_semaphore = sem_open(ROOMS_SEM_NAME, O_CREAT | O_EXCL, 0644, 1);
-    current_client_wait_sem = sem_open(CURRENT_CLIENT_WAIT_SEM_NAME, O_CREAT | O_EXCL, 0644, 1);
-    client_file = fopen("clients.txt", "r");
+    client_slots_free_sem = sem_open(CLIENT_SLOTS_FREE_SEM_NAME, O_CREAT | O_EXCL, 0644, CLIENT_RING_SIZE);
+    client_slots_used_sem = sem_open(CLIENT_SLOTS_USED_SEM_NAME, O_CREAT | O_EXCL, 0644, 0);
+
+    // Строки журнала клиентов выводит фоновый поток отеля, забирая записи из кольца в сегменте.
+    event_log_writer_start(&log_writer, rooms_segment_log(&rooms_data->rooms), STDOUT_FILENO);
 
     // Теперь зарегистрируем обработчик SIGTERM, чтобы корректно закрыть семафоры и shared memory.
     __sighandler_t previous = signal(SIGTERM, handle_sigterm);
 
-    // Во время чтения пишем данные запускаемого клиента в shared memory.
-    // Далее ждем, пока запущенный процесс заберет эту порцию данных.
-    while (fscanf(client_file, "%d %d %d",
-                  &rooms_data->current_client_id,
-                  &rooms_data->current_client_gender,
-                  &rooms_data->current_client_rent_time) > 0) {
-        // Блокируем мутекс для того, чтобы в следующий раз мы ждали запуска процесса и получения им данных.
-        sem_wait(current_client_wait_sem);
+    // Обработчик SIGUSR1 ставится без SA_RESTART, чтобы сигнал прерывал ожидание клиентов и статистика печаталась
+    // сразу, а не после выхода очередного клиента.
+    struct sigaction stats_action;
+    memset(&stats_action, 0, sizeof(stats_action));
+    stats_action.sa_handler = handle_sigusr1;
+    sigaction(SIGUSR1, &stats_action, NULL);
+
+    // Поток выездов запускается до первого клиента. Дочерние процессы его не наследуют: fork копирует только
+    // вызвавший его поток.
+    if (hotel_checkouts_start(&checkouts, &rooms_data->rooms, hotel_checkouts_release) == -1) {
+        perror("hotel_checkouts_start");
+        free_resources();
+    }
+
+    // В режиме пула потоков клиенты обслуживаются внутри процесса отеля без fork.
+    if (config.worker_threads > 0) {
+        run_worker_threads(config.worker_threads);
+        wait_checkouts();
+    }
+
+    // Кладем данные очередного клиента в кольцевой буфер в shared memory и запускаем процесс,
+    // который заберет оттуда какую-нибудь запись. Ждать отель будет, только если буфер заполнен.
+    for (int i = 0; i < clients.count; ++i) {
+        client_record_t record;
+        clients_get(&clients, i, &record);
+        // Сигнал SIGUSR1 (печать статистики) прерывает ожидание, поэтому оно повторяется.
+        while (sem_wait(client_slots_free_sem) == -1 && errno == EINTR) {
+            print_requested_stats();
+        }
+
+        client_ring_push(&rooms_data->clients, &record);
+        sem_post(client_slots_used_sem);
 
         // Если же этот код уже исполняется в дочернем процессе
         if (fork() == 0) {
             is_child_process = true;
             signal(SIGTERM, previous);
-            sem_post(current_client_wait_sem);
-            handle_client_process(rooms_data, rooms_semaphore, current_client_wait_sem);
+            handle_client_process(rooms_data, client_slots_free_sem, client_slots_used_sem);
             break;
         }
 
-        sem_wait(current_client_wait_sem);
+        print_requested_stats();
+    }
+
+    // Ждем завершения клиентов, печатая статистику по каждому SIGUSR1.
+    while (wait(NULL) > 0 || errno == EINTR) {
+        print_requested_stats();
+    }
+
+    if (!is_child_process) {
+        wait_checkouts();
     }
 
     free_resources();
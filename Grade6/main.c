@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
@@ -6,179 +7,342 @@
 #include <sys/shm.h>
 #include <sys/wait.h>
 #include <stdlib.h>
+#include <pthread.h>
 
-#define SINGLE_ROOMS_COUNT 10
-#define DOUBLE_ROOMS_COUNT 15
+#include "../common/client_ring.h"
+#include "../common/clients.h"
+#include "../common/hotel_checkouts.h"
+#include "../common/rooms_segment.h"
 
-// Статус комнаты.
-typedef enum {
-    freed,
-    busied_by_man,
-    busied_by_woman,
-    full
-} room_status;
+// Номера семафоров свободных и занятых ячеек кольцевого буфера клиентов в наборе client_slots_sem_id.
+#define CLIENT_SLOTS_FREE 0
+#define CLIENT_SLOTS_USED 1
 
 // Структура с данными о состоянии комнат.
 typedef struct {
-    room_status single_rooms[SINGLE_ROOMS_COUNT];
-    room_status double_rooms[DOUBLE_ROOMS_COUNT];
-    // Данные клиента запускаемого в данный момент процесса.
-    int current_client_id;
-    int current_client_gender;
-    int current_client_rent_time;
+    // Записи клиентов, которые отель передает запускаемым процессам.
+    client_ring_t clients;
+    // Заголовок состояния комнат, массивы номеров лежат в этой же памяти сразу за ним.
+    rooms_header_t rooms;
 } rooms_data_t;
 
-// Ожидает разблокировки семафора.
-void wait_semaphore(int sem_id) {
+// Изменяет счетчик семафора sem_num на delta одной операцией semop.
+// Уменьшение ждет, пока счетчик не станет достаточно большим.
+void change_semaphore(int sem_id, unsigned short sem_num, short delta) {
     struct sembuf sem_op;
-    sem_op.sem_num = 0;
-    sem_op.sem_op = 0;
+    sem_op.sem_num = sem_num;
+    sem_op.sem_op = delta;
     sem_op.sem_flg = 0;
-    semop(sem_id, &sem_op, 1);
-    semctl(sem_id, 0, SETVAL, 1);
+
+    // Сигнал SIGUSR1 (печать статистики) прерывает ожидание, поэтому операция повторяется.
+    while (semop(sem_id, &sem_op, 1) == -1 && errno == EINTR) {
+    }
+}
+
+// Записывает в журнал строку о заселении клиента в забронированный номер.
+void log_booking(event_log_t *log, rooms_header_t *rooms, const rooms_booking_t *booking, int client_id,
+                 int client_gender) {
+    int room_idx = rooms_booking_room(rooms, booking);
+
+    if (!booking->is_double) {
+        event_log_write(log, log_client_rent_single, client_id, room_idx, 0);
+    } else if (booking->previous_status == freed) {
+        event_log_write(log, log_client_rent_double, client_id, room_idx, client_gender);
+    } else {
+        event_log_write(log, log_client_rent_double_shared, client_id, room_idx, client_gender);
+    }
+}
+
+// Освобождает номер гостя, отдает его листу ожидания и записывает выезд в журнал. Строка о выезде записывается под
+// семафором шарда, а номер достанется следующему клиенту только после того, как семафор будет освобожден. Поэтому
+// в журнале выезд всегда идет раньше следующего заселения в тот же номер: по журналу можно проверить, что номер
+// не достался двоим сразу (bench/lock_stress.c grade6).
+void release_client(rooms_header_t *rooms, const rooms_checkout_t *checkout) {
+    uint64_t hold_started_at = rooms_shard_lock(rooms, checkout->booking.shard);
+    rooms_segment_release(rooms, &checkout->booking, checkout->gender, 0);
+    event_log_write(rooms_segment_log(rooms), log_client_end_of_rent, checkout->client_id, 0, 0);
+    rooms_shard_unlock(rooms, checkout->booking.shard, hold_started_at);
+    rooms_waitlist_notify(rooms, 1);
+    stats_count(&rooms_segment_stats(rooms)->released);
 }
 
 // Обрабатывает логику клиента отеля.
-void handle_client_process(rooms_data_t *data, int rooms_semaphore_id, int current_client_wait_sem_id) {
-    int client_id = data->current_client_id;
-    int client_gender = data->current_client_gender;
-    int client_rent_time = data->current_client_rent_time;
-    printf("[CLIENT-%d] started.\n", client_id);
-    semctl(current_client_wait_sem_id, 0, SETVAL, 0);
-
-    // Ищем свободную комнату, перед этим блокируем семафор.
-    wait_semaphore(rooms_semaphore_id);
-
-    // Сначала проверим комнаты на одно спальное место.
-    int used_single_idx = -1;
-    int used_double_idx = -1;
-
-    for (int i = 0; i < SINGLE_ROOMS_COUNT; ++i) {
-        if (data->single_rooms[i] == freed) {
-            printf("[CLIENT-%d] rent single room: idx = %li.\n", client_id, i);
-            data->single_rooms[i] = full;
-            used_single_idx = i;
-            break;
-        }
+void handle_client(rooms_data_t *data, int client_id, int client_gender, int client_rent_time) {
+    hotel_stats_t *stats = rooms_segment_stats(&data->rooms);
+    // События клиента записываются в кольцо журнала в сегменте, а строки из них выводит отель.
+    event_log_t *log = rooms_segment_log(&data->rooms);
+    event_log_write(log, log_client_started, client_id, 0, 0);
+
+    // Ищем свободную комнату: сначала в шарде клиента, затем в соседних. Сначала проверяются комнаты на одно
+    // спальное место, затем на два, но при условии, что комната пуста или в ней живет человек того же пола.
+    // Каждый шард на время поиска блокируется своим семафором из набора System V, поэтому клиенты из разных шардов
+    // не ждут друг друга. Шарды, в которых по счетчикам номеров мест нет, пропускаются, не дожидаясь их семафоров.
+    // Время ожидания и удержания семафоров попадает в статистику отеля.
+    rooms_booking_t booking;
+    rooms_waiter_t *waiter = NULL;
+    int booked = rooms_waitlist_book(&data->rooms, client_id, client_gender, 1, &booking, &waiter);
+
+    // Если мест нет, клиент встает в лист ожидания (если он включен) и спит, пока отель не забронирует ему
+    // освободившийся номер.
+    if (booked == 1) {
+        event_log_write(log, log_client_waiting_room, client_id, 0, 0);
+        stats_count(&stats->waitlisted);
+        uint64_t wait_started_at = stats_now_ns();
+        booked = rooms_waitlist_wait(waiter, &booking);
+        stats_record(&stats->waitlist_wait, wait_started_at);
     }
 
-    // Если же не нашли на одно место, то поищем на два места, но при условии, либо комната пуста,
-    // либо в ней живет человек того же пола.
-    if (used_single_idx == -1) {
-        for (int i = 0; i < DOUBLE_ROOMS_COUNT; ++i) {
-            if (data->double_rooms[i] == freed) {
-                data->double_rooms[i] = client_gender == 0 ? busied_by_man : busied_by_woman;
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d.\n", client_id, i, client_gender);
-                used_double_idx = i;
-                break;
-            } else if ((data->double_rooms[i] == busied_by_man && client_gender == 0) ||
-                       (data->double_rooms[i] == busied_by_woman && client_gender == 1)) {
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d, with_gender = %d.\n", client_id, i,
-                       client_gender, client_gender);
-
-                data->double_rooms[i] = full;
-                used_double_idx = i;
-                break;
-            }
+    // Отказ клиенту из листа ожидания записывает в журнал отель, закрывая лист.
+    if (booked == -1) {
+        if (waiter == NULL) {
+            event_log_write(log, log_client_out_of_service, client_id, 0, 0);
         }
+        stats_count(&stats->rejected);
+        return;
     }
 
-    // Разблокируем семафор, чтобы другой процесс забронировал комнату.
-    semctl(rooms_semaphore_id, 0, SETVAL, 0);
+    log_booking(log, &data->rooms, &booking, client_id, client_gender);
 
-    // Если нашли комнату, то значит, что статус мы изменили.
-    if (used_double_idx == -1 && used_single_idx == -1) {
-        printf("[CLIENT-%d] out of service!\n", client_id);
+    // Бронируем комнату и ждем ...
+    stats_count(&stats->booked);
+    event_log_write(log, log_client_waiting_rent, client_id, client_rent_time, 0);
+    rooms_checkout_t checkout = {stats_now_ns() + (uint64_t) client_rent_time * 1000000000, client_id, client_gender,
+                                 booking};
+
+    // Номер по окончании аренды освобождает поток выездов отеля, а клиент сразу уходит: дочерний процесс
+    // завершается, поток пула переходит к следующему клиенту. Аренда нулевой длины уже закончилась, и номер
+    // освобождается сразу: иначе следующие клиенты успели бы получить отказ, пока выезд лежит в очереди.
+    if (client_rent_time == 0) {
+        release_client(&data->rooms, &checkout);
         return;
     }
 
-    // Бронируем комнату и ждем ...
-    printf("[CLIENT-%d] waiting %ds.\n", client_id, client_rent_time);
-    sleep(client_rent_time);
-
-    // Теперь освободим комнату.
-    wait_semaphore(rooms_semaphore_id);
-
-    if (used_double_idx >= 0) {
-        if (data->double_rooms[used_double_idx] == full) {
-            data->double_rooms[used_double_idx] = client_gender == 0 ? busied_by_man : busied_by_woman;
-        } else if (data->double_rooms[used_double_idx] == busied_by_man ||
-                   data->double_rooms[used_double_idx] == busied_by_woman) {
-            data->double_rooms[used_double_idx] = freed;
-        }
-    } else if (used_single_idx >= 0) {
-        data->single_rooms[used_single_idx] = freed;
-    }
+    rooms_checkouts_push(&data->rooms, &checkout);
+}
 
-    printf("[CLIENT-%d] end of rent!\n", client_id);
-    semctl(rooms_semaphore_id, 0, SETVAL, 0);
+// Забирает запись клиента из кольцевого буфера в shared memory и обрабатывает его логику в дочернем процессе.
+void handle_client_process(rooms_data_t *data, int client_slots_sem_id) {
+    client_record_t record;
+    change_semaphore(client_slots_sem_id, CLIENT_SLOTS_USED, -1);
+    client_ring_pop(&data->clients, &record);
+    change_semaphore(client_slots_sem_id, CLIENT_SLOTS_FREE, 1);
+    handle_client(data, record.id, record.gender, record.rent_time);
 }
 
 // Общие переменные для работы программы.
 int rooms_fd;
 bool is_child_process;
-FILE *client_file;
+// Записи всех клиентов, загруженные до начала моделирования, и индекс следующей записи для пула потоков.
+clients_trace_t clients;
+int next_client_record;
 rooms_data_t *rooms_data;
-int current_client_wait_sem_id;
+size_t rooms_data_size;
+// Фоновый писатель журнала клиентов в процессе отеля.
+event_log_writer_t log_writer;
+// Поток выездов отеля, освобождающий номера по окончании аренды.
+hotel_checkouts_t checkouts;
+// Выставляется обработчиком SIGUSR1, статистику печатают циклы отеля.
+volatile sig_atomic_t stats_requested;
+int client_slots_sem_id;
+// Набор семафоров System V, по семафору на шард номеров.
 int rooms_semaphore_id;
 
+// Печатает статистику отеля, если ее запросили сигналом SIGUSR1. Печатать в самом обработчике нельзя: сигнал
+// может прийти, пока процесс уже выводит строку и держит блокировку stdout.
+void print_requested_stats() {
+    if (!is_child_process && __atomic_exchange_n(&stats_requested, 0, __ATOMIC_RELAXED)) {
+        stats_print_stripes(stdout, &rooms_data->rooms.stats);
+    }
+}
+
+// Обслуживает клиентов из общего массива записей, пока они не закончатся. Статистику по SIGUSR1 печатают сами
+// потоки пула между клиентами: основной поток в это время ждет их завершения.
+void *handle_worker_thread(__attribute__((unused)) void *arg) {
+    int idx;
+
+    while ((idx = __atomic_fetch_add(&next_client_record, 1, __ATOMIC_RELAXED)) < clients.count) {
+        print_requested_stats();
+        client_record_t record;
+        clients_get(&clients, idx, &record);
+        handle_client(rooms_data, record.id, record.gender, record.rent_time);
+    }
+
+    return NULL;
+}
+
+// Обслуживает всех клиентов пулом из threads_count потоков внутри текущего процесса.
+void run_worker_threads(int threads_count) {
+    pthread_t *threads = malloc(sizeof(pthread_t) * threads_count);
+    sigset_t signals, previous_signals;
+
+    // Потоки наследуют маску сигналов: SIGUSR1 обрабатывает только основной поток, чтобы сигнал
+    // не прервал ожидание семафора в обслуживающем потоке.
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+
+    for (int i = 0; i < threads_count; ++i) {
+        pthread_create(&threads[i], NULL, handle_worker_thread, NULL);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+
+    for (int i = 0; i < threads_count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+}
+
 // Освобождает занятые процессом ресурсы.
 void free_resources() {
     // Ждем завершения всех дочерних процессов.
     while (wait(NULL) > 0) {
     }
 
+    // Останавливаем поток выездов, если он еще работает, выводим журнал клиентов до конца и останавливаем его
+    // писателя.
+    if (!is_child_process) {
+        hotel_checkouts_stop(&checkouts, 0);
+        event_log_writer_stop(&log_writer);
+    }
+
     // Освобождаем ресурсы.
-    fclose(client_file);
-    semctl(rooms_semaphore_id, 0, IPC_RMID, 0);
-    semctl(current_client_wait_sem_id, 0, IPC_RMID, 0);
+    clients_free(&clients);
     shmdt(rooms_data);
+
+    // Семафоры номеров и кольца клиентов удаляет только отель, дождавшись всех клиентов: процесс клиента, удаливший
+    // их при выходе, оставил бы остальных клиентов без блокировки.
+    if (!is_child_process) {
+        semctl(rooms_semaphore_id, 0, IPC_RMID, 0);
+        semctl(client_slots_sem_id, 0, IPC_RMID, 0);
+        shmctl(rooms_fd, IPC_RMID, NULL);
+    }
+
     exit(1);
 }
 
 // Обрабатывает сигнал завершения программы.
 void handle_sigterm(__attribute__((unused)) int signal) {
+    // Отель будит клиентов из листа ожидания, иначе он не дождется их завершения.
+    if (!is_child_process) {
+        rooms_waitlist_close(&rooms_data->rooms);
+    }
+
     free_resources();
 }
 
-int main() {
+// Запрашивает печать статистики по сигналу SIGUSR1: kill -USR1 <pid>.
+void handle_sigusr1(__attribute__((unused)) int signal) {
+    stats_requested = 1;
+}
+
+// Дожидается, пока поток выездов не освободит номера всех гостей, и завершает отель. Клиенты к этому моменту уже
+// поручили все выезды. Статистика печатается по каждому SIGUSR1.
+void wait_checkouts() {
+    hotel_checkouts_finish(&checkouts);
+    while (hotel_checkouts_wait(&checkouts) == -1) {
+        print_requested_stats();
+    }
+
+    free_resources();
+}
+
+int main(int argc, char *argv[]) {
     is_child_process = false;
 
+    // Строки журнала выводятся сразу, даже если вывод перенаправлен в канал, как в терминале.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Число номеров задается аргументами или файлом конфигурации.
+    rooms_config_t config;
+    if (rooms_config_parse(&config, argc, argv) == -1) {
+        return 1;
+    }
+
+    // Номера освобождает поток выездов отеля, которому клиенты передают выезды через очередь в сегменте. Поэтому
+    // поток пула, ожидающий в листе, не мешает освобождать номера, и лист ожидания работает одинаково с процессом
+    // на каждого клиента и с пулом потоков.
+    config.hotel_checkouts = 1;
+
+    // Загружаем всех клиентов до начала моделирования: кольцо журнала в сегменте рассчитывается на их события.
+    if (clients_load(&clients, config.clients_path) == -1) {
+        perror("clients_load");
+        return 1;
+    }
+
+    rooms_config_log_clients(&config, clients.count);
+    rooms_data_size = offsetof(rooms_data_t, rooms) +
+                      rooms_segment_size(&config);
+
     // Инициализируем доступ к shared memory для работы с состояниями комнат.
-    rooms_fd = shmget(IPC_PRIVATE, sizeof(rooms_data_t), IPC_CREAT | 0666);
+    rooms_fd = shmget(IPC_PRIVATE, rooms_data_size, IPC_CREAT | 0666);
     rooms_data = shmat(rooms_fd, NULL, 0);
 
     // Инициализируем состояние комнат.
-    memset(rooms_data->single_rooms, freed, sizeof(room_status) * SINGLE_ROOMS_COUNT);
-    memset(rooms_data->double_rooms, freed, sizeof(room_status) * DOUBLE_ROOMS_COUNT);
+    rooms_segment_init(&rooms_data->rooms, &config);
+    client_ring_init(&rooms_data->clients);
 
     // Открываем семафоры для первичной инициализации.
-    rooms_semaphore_id = semget(IPC_PRIVATE, 1, IPC_CREAT | 0666);;
-    current_client_wait_sem_id = semget(IPC_PRIVATE, 1, IPC_CREAT | 0666);
-    client_file = fopen("clients.txt", "r");
+    rooms_semaphore_id = semget(IPC_PRIVATE, rooms_data->rooms.shards_count, IPC_CREAT | 0666);
+    rooms_segment_use_sysv_locks(&rooms_data->rooms, rooms_semaphore_id);
+    client_slots_sem_id = semget(IPC_PRIVATE, 2, IPC_CREAT | 0666);
+    semctl(client_slots_sem_id, CLIENT_SLOTS_FREE, SETVAL, CLIENT_RING_SIZE);
+    semctl(client_slots_sem_id, CLIENT_SLOTS_USED, SETVAL, 0);
+
+    // Строки журнала клиентов выводит фоновый поток отеля, забирая записи из кольца в сегменте.
+    event_log_writer_start(&log_writer, rooms_segment_log(&rooms_data->rooms), STDOUT_FILENO);
 
     // Теперь зарегистрируем обработчик SIGTERM, чтобы корректно закрыть семафоры и shared memory.
     __sighandler_t previous = signal(SIGTERM, handle_sigterm);
 
-    // Во время чтения пишем данные запускаемого клиента в shared memory.
-    // Далее ждем, пока запущенный процесс заберет эту порцию данных.
-    while (fscanf(client_file, "%d %d %d",
-                  &rooms_data->current_client_id,
-                  &rooms_data->current_client_gender,
-                  &rooms_data->current_client_rent_time) > 0) {
-        // Блокируем мутекс для того, чтобы в следующий раз мы ждали запуска процесса и получения им данных.
-        wait_semaphore(current_client_wait_sem_id);
+    // Обработчик SIGUSR1 ставится без SA_RESTART, чтобы сигнал прерывал ожидание клиентов и статистика печаталась
+    // сразу, а не после выхода очередного клиента.
+    struct sigaction stats_action;
+    memset(&stats_action, 0, sizeof(stats_action));
+    stats_action.sa_handler = handle_sigusr1;
+    sigaction(SIGUSR1, &stats_action, NULL);
+
+    // Поток выездов запускается до первого клиента. Дочерние процессы его не наследуют: fork копирует только
+    // вызвавший его поток.
+    if (hotel_checkouts_start(&checkouts, &rooms_data->rooms, release_client) == -1) {
+        perror("hotel_checkouts_start");
+        free_resources();
+    }
+
+    // В режиме пула потоков клиенты обслуживаются внутри процесса отеля без fork.
+    if (config.worker_threads > 0) {
+        run_worker_threads(config.worker_threads);
+        wait_checkouts();
+    }
+
+    // Кладем данные очередного клиента в кольцевой буфер в shared memory и запускаем процесс,
+    // который заберет оттуда какую-нибудь запись. Ждать отель будет, только если буфер заполнен.
+    for (int i = 0; i < clients.count; ++i) {
+        client_record_t record;
+        clients_get(&clients, i, &record);
+        change_semaphore(client_slots_sem_id, CLIENT_SLOTS_FREE, -1);
+        client_ring_push(&rooms_data->clients, &record);
+        change_semaphore(client_slots_sem_id, CLIENT_SLOTS_USED, 1);
 
         // Если же этот код уже исполняется в дочернем процессе
         if (fork() == 0) {
             is_child_process = true;
             signal(SIGTERM, previous);
-            semctl(current_client_wait_sem_id, 0, SETVAL, 0);
-            handle_client_process(rooms_data, rooms_semaphore_id, current_client_wait_sem_id);
+            handle_client_process(rooms_data, client_slots_sem_id);
             break;
         }
 
-        wait_semaphore(current_client_wait_sem_id);
+        print_requested_stats();
+    }
+
+    // Ждем завершения клиентов, печатая статистику по каждому SIGUSR1.
+    while (wait(NULL) > 0 || errno == EINTR) {
+        print_requested_stats();
+    }
+
+    if (!is_child_process) {
+        wait_checkouts();
     }
 
     free_resources();
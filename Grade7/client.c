@@ -1,41 +1,26 @@
 #include <fcntl.h>
 #include <sys/mman.h>
-#include <semaphore.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+
+#include "../common/hotel_checkouts.h"
+#include "../common/rooms_segment.h"
 
-#define SINGLE_ROOMS_COUNT 10
-#define DOUBLE_ROOMS_COUNT 15
 #define ROOMS_MEM_NAME "/rooms_mem"
-#define ROOMS_SEM_NAME "/rooms_sem182003"
-
-// Статус комнаты.
-typedef enum {
-    freed,
-    busied_by_man,
-    busied_by_woman,
-    full
-} room_status;
-
-// Структура с данными о состоянии комнат.
-typedef struct {
-    room_status single_rooms[SINGLE_ROOMS_COUNT];
-    room_status double_rooms[DOUBLE_ROOMS_COUNT];
-} rooms_data_t;
 
 // Общие переменные для работы программы.
 int rooms_fd;
-rooms_data_t *rooms_data;
-sem_t *rooms_semaphore;
+// Сегмент с состоянием комнат: заголовок, за которым следуют массивы номеров.
+rooms_header_t *rooms_data;
+size_t rooms_data_size;
 
 // Освобождает занятые процессом ресурсы.
 void free_resources() {
-    sem_close(rooms_semaphore);
-    sem_destroy(rooms_semaphore);
-    munmap(rooms_data, sizeof(rooms_data_t));
+    munmap(rooms_data, rooms_data_size);
     exit(1);
 }
 
@@ -47,84 +32,82 @@ void handle_sigterm(__attribute__((unused)) int signal) {
 }
 
 int main(__attribute__((unused)) int argc, char* argv[]) {
+    // Строки журнала выводятся сразу, даже если вывод перенаправлен в канал, как в терминале.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
     int client_id = atoi(argv[1]);
     int client_gender = atoi(argv[2]);
     int client_rent_time = atoi(argv[3]);
 
     // Инициализируем доступ к shared memory для работы с состояниями комнат.
+    // Сначала отображаем только заголовок, чтобы узнать размер сегмента, выбранный отелем.
     rooms_fd = shm_open(ROOMS_MEM_NAME, O_RDWR | O_EXCL, 0666);
-    rooms_data = mmap(NULL, sizeof(rooms_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, rooms_fd, 0);
-    rooms_semaphore = sem_open(ROOMS_SEM_NAME, O_EXCL, 0644, 1);
-    signal(SIGTERM, handle_sigterm);
-
-    // Ищем свободную комнату, перед этим блокируем семафор.
-    sem_wait(rooms_semaphore);
+    rooms_data = mmap(NULL, sizeof(rooms_header_t), PROT_READ, MAP_SHARED, rooms_fd, 0);
+    if (rooms_data == MAP_FAILED || !rooms_segment_is_valid(rooms_data)) {
+        printf("[CLIENT-%d] hotel is not running!\n", client_id);
+        return 1;
+    }
 
-    // Теперь поищем нужный нам отель!
-    // Сначала проверим комнаты на одно спальное место.
-    int used_single_idx = -1;
-    int used_double_idx = -1;
+    rooms_data_size = rooms_data->size;
+    munmap(rooms_data, sizeof(rooms_header_t));
+    rooms_data = mmap(NULL, rooms_data_size, PROT_READ | PROT_WRITE, MAP_SHARED, rooms_fd, 0);
+    signal(SIGTERM, handle_sigterm);
 
-    for (int i = 0; i < SINGLE_ROOMS_COUNT; ++i) {
-        if (rooms_data->single_rooms[i] == freed) {
-            printf("[CLIENT-%d] rent single room: idx = %li.\n", client_id, i);
-            rooms_data->single_rooms[i] = full;
-            used_single_idx = i;
-            break;
-        }
+    // Ищем свободную комнату: сначала в шарде клиента, затем в соседних. Сначала проверяются комнаты на одно
+    // спальное место, затем на два, но при условии, что комната пуста или в ней живет человек того же пола.
+    // Каждый шард на время поиска блокируется своей блокировкой в сегменте, поэтому клиенты из разных шардов не ждут
+    // друг друга. В режиме CAS статусы номеров меняются атомарно, и блокировки не нужны.
+    // Время ожидания и удержания блокировок попадает в статистику отеля.
+    hotel_stats_t *stats = rooms_segment_stats(rooms_data);
+    // События клиента записываются в кольцо журнала в сегменте, а строки из них выводит отель.
+    event_log_t *log = rooms_segment_log(rooms_data);
+    rooms_booking_t booking;
+    rooms_waiter_t *waiter = NULL;
+    int booked = rooms_waitlist_book(rooms_data, client_id, client_gender, 1, &booking, &waiter);
+
+    // Если мест нет, клиент встает в лист ожидания (если он включен) и спит, пока отель не забронирует ему
+    // освободившийся номер.
+    if (booked == 1) {
+        event_log_write(log, log_client_waiting_room, client_id, 0, 0);
+        stats_count(&stats->waitlisted);
+        uint64_t wait_started_at = stats_now_ns();
+        booked = rooms_waitlist_wait(waiter, &booking);
+        stats_record(&stats->waitlist_wait, wait_started_at);
     }
 
-    // Если же не нашли на одно место, то поищем на два места, но при условии, либо комната пуста,
-    // либо в ней живет человек того же пола.
-    if (used_single_idx == -1) {
-        for (int i = 0; i < DOUBLE_ROOMS_COUNT; ++i) {
-            if (rooms_data->double_rooms[i] == freed) {
-                rooms_data->double_rooms[i] = client_gender == 0 ? busied_by_man : busied_by_woman;
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d.\n", client_id, i, client_gender);
-                used_double_idx = i;
-                break;
-            } else if ((rooms_data->double_rooms[i] == busied_by_man && client_gender == 0) ||
-                       (rooms_data->double_rooms[i] == busied_by_woman && client_gender == 1)) {
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d, with_gender = %d.\n", client_id, i,
-                       client_gender, client_gender);
-
-                rooms_data->double_rooms[i] = full;
-                used_double_idx = i;
-                break;
-            }
+    // Отказ клиенту из листа ожидания записывает в журнал отель, закрывая лист.
+    if (booked == -1) {
+        if (waiter == NULL) {
+            event_log_write(log, log_client_out_of_service, client_id, 0, 0);
         }
-    }
-
-    // Разблокируем семафор, чтобы другой процесс забронировал комнату.
-    sem_post(rooms_semaphore);
-
-    // Если нашли комнату, то значит, что статус мы изменили.
-    if (used_double_idx == -1 && used_single_idx == -1) {
-        printf("[CLIENT-%d] out of service!\n", client_id);
+        stats_count(&stats->rejected);
         free_resources();
         return 0;
     }
 
+    int room_idx = rooms_booking_room(rooms_data, &booking);
+    if (!booking.is_double) {
+        event_log_write(log, log_client_rent_single, client_id, room_idx, 0);
+    } else if (booking.previous_status == freed) {
+        event_log_write(log, log_client_rent_double, client_id, room_idx, client_gender);
+    } else {
+        event_log_write(log, log_client_rent_double_shared, client_id, room_idx, client_gender);
+    }
+
     // Бронируем комнату и ждем ...
-    printf("[CLIENT-%d] waiting %ds.\n", client_id, client_rent_time);
-    sleep(client_rent_time);
-
-    // Теперь освободим комнату.
-    sem_wait(rooms_semaphore);
-
-    if (used_double_idx >= 0) {
-        if (rooms_data->double_rooms[used_double_idx] == full) {
-            rooms_data->double_rooms[used_double_idx] = client_gender == 0 ? busied_by_man : busied_by_woman;
-        } else if (rooms_data->double_rooms[used_double_idx] == busied_by_man ||
-                   rooms_data->double_rooms[used_double_idx] == busied_by_woman) {
-            rooms_data->double_rooms[used_double_idx] = freed;
-        }
-    } else if (used_single_idx >= 0) {
-        rooms_data->single_rooms[used_single_idx] = freed;
+    stats_count(&stats->booked);
+    event_log_write(log, log_client_waiting_rent, client_id, client_rent_time, 0);
+    rooms_checkout_t checkout = {stats_now_ns() + (uint64_t) client_rent_time * 1000000000, client_id, client_gender,
+                                 booking};
+
+    // Номер по окончании аренды освобождает поток выездов отеля, а клиент сразу завершается. Аренда нулевой длины
+    // уже закончилась, и номер освобождается сразу.
+    if (client_rent_time == 0) {
+        hotel_checkouts_release(rooms_data, &checkout);
+    } else {
+        rooms_checkouts_push(rooms_data, &checkout);
     }
 
-    printf("[CLIENT-%d] end of rent!\n", client_id);
-    sem_post(rooms_semaphore);
     free_resources();
     return 0;
 }
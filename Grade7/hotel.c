@@ -3,43 +3,39 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/wait.h>
-#include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#define SINGLE_ROOMS_COUNT 10
-#define DOUBLE_ROOMS_COUNT 15
+#include "../common/hotel_checkouts.h"
+#include "../common/rooms_segment.h"
+
 #define ROOMS_MEM_NAME "/rooms_mem"
-#define ROOMS_SEM_NAME "/rooms_sem182003"
-
-// Статус комнаты.
-typedef enum {
-    freed,
-    busied_by_man,
-    busied_by_woman,
-    full
-} room_status;
-
-// Структура с данными о состоянии комнат.
-typedef struct {
-    room_status single_rooms[SINGLE_ROOMS_COUNT];
-    room_status double_rooms[DOUBLE_ROOMS_COUNT];
-} rooms_data_t;
 
 // Общие переменные для работы программы.
 int rooms_fd;
-rooms_data_t *rooms_data;
-sem_t *rooms_semaphore;
+// Сегмент с состоянием комнат: заголовок, за которым следуют массивы номеров.
+rooms_header_t *rooms_data;
+size_t rooms_data_size;
+// Фоновый писатель журнала клиентов.
+event_log_writer_t log_writer;
+// Поток выездов, освобождающий номера гостей по окончании аренды.
+hotel_checkouts_t checkouts;
+// Выставляется обработчиком SIGUSR1, статистику печатает основной цикл.
+volatile sig_atomic_t stats_requested;
 
 // Освобождает занятые процессом ресурсы.
 void free_resources() {
     printf("[HOTEL] Stopping ...\n");
 
-    // Освобождаем ресурсы.
-    sem_close(rooms_semaphore);
-    sem_unlink(ROOMS_SEM_NAME);
-    sem_destroy(rooms_semaphore);
-    munmap(rooms_data, sizeof(rooms_data_t));
+    // Останавливаем поток выездов: гости, чья аренда еще не закончилась, выезжают вместе с остановкой отеля, и строк
+    // о выезде для них в журнале нет.
+    hotel_checkouts_stop(&checkouts, 0);
+
+    // Будим клиентов из листа ожидания: номеров они уже не дождутся. Их отказы отель записывает в журнал сам, при
+    // закрытии листа, поэтому они попадают в остаток журнала, который выводится перед освобождением ресурсов.
+    rooms_waitlist_close(rooms_data);
+    event_log_writer_stop(&log_writer);
+    munmap(rooms_data, rooms_data_size);
     shm_unlink(ROOMS_MEM_NAME);
     exit(1);
 }
@@ -51,24 +47,61 @@ void handle_sigterm(__attribute__((unused)) int signal) {
     }
 }
 
-int main() {
+// Запрашивает печать статистики по сигналу SIGUSR1: kill -USR1 <pid>.
+void handle_sigusr1(__attribute__((unused)) int signal) {
+    stats_requested = 1;
+}
+
+int main(int argc, char *argv[]) {
+    // Строки журнала выводятся сразу, даже если вывод перенаправлен в канал, как в терминале.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Число номеров задается аргументами или файлом конфигурации, бронирование без блокировки (через
+    // compare-and-swap) включается аргументом "cas": ./hotel.out 1000 500 cas
+    rooms_config_t config;
+    if (rooms_config_parse(&config, argc, argv) == -1) {
+        return 1;
+    }
+
+    // Клиенты не ждут окончания аренды сами, а передают выезды отелю через очередь в сегменте.
+    config.hotel_checkouts = 1;
+
+    rooms_data_size = rooms_segment_size(&config);
     // Инициализируем доступ к shared memory для работы с состояниями комнат.
     rooms_fd = shm_open(ROOMS_MEM_NAME, O_RDWR | O_CREAT, 0666);
-    ftruncate(rooms_fd, sizeof(rooms_data_t));
-    rooms_data = mmap(NULL, sizeof(rooms_data_t), PROT_READ | PROT_WRITE, MAP_SHARED, rooms_fd, 0);
+    ftruncate(rooms_fd, rooms_data_size);
+    rooms_data = mmap(NULL, rooms_data_size, PROT_READ | PROT_WRITE, MAP_SHARED, rooms_fd, 0);
 
-    // Инициализируем состояние комнат.
-    memset(rooms_data->single_rooms, freed, sizeof(room_status) * SINGLE_ROOMS_COUNT);
-    memset(rooms_data->double_rooms, freed, sizeof(room_status) * DOUBLE_ROOMS_COUNT);
+    // Инициализируем состояние комнат и блокировку номеров в заголовке сегмента.
+    rooms_segment_init(rooms_data, &config);
+
+    // Клиенты записывают события в кольцо журнала в сегменте, а строки из них выводит фоновый поток отеля.
+    event_log_writer_start(&log_writer, rooms_segment_log(rooms_data), STDOUT_FILENO);
+
+    // Номера гостей по окончании аренды освобождает поток выездов отеля.
+    if (hotel_checkouts_start(&checkouts, rooms_data, hotel_checkouts_release) == -1) {
+        perror("hotel_checkouts_start");
+        free_resources();
+    }
 
-    // Открываем семафоры для первичной инициализации.
-    rooms_semaphore = sem_open(ROOMS_SEM_NAME, O_CREAT | O_EXCL, 0644, 1);
     printf("[HOTEL] Started state hosting.\n");
     signal(SIGTERM, handle_sigterm);
+    signal(SIGUSR1, handle_sigusr1);
     fflush(stdout);
 
-    // Ожидаем теперь SIGCONTINUE.
-    pause();
-    free_resources();
-    return 0;
+    // Ожидаем теперь SIGTERM, печатая статистику по каждому SIGUSR1. Вне sigsuspend сигнал SIGUSR1 заблокирован:
+    // пришедший во время печати будет доставлен при следующем ожидании, а не потеряется между проверкой и ожиданием.
+    sigset_t signals, previous_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &signals, &previous_signals);
+
+    while (1) {
+        sigsuspend(&previous_signals);
+
+        if (stats_requested) {
+            stats_requested = 0;
+            stats_print_stripes(stdout, &rooms_data->stats);
+        }
+    }
 }
@@ -1,46 +1,21 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/sem.h>
 #include <sys/shm.h>
 #include <sys/wait.h>
 #include <stdio.h>
+#include <stdbool.h>
 
-#define SINGLE_ROOMS_COUNT 10
-#define DOUBLE_ROOMS_COUNT 15
-
-// Статус комнаты.
-typedef enum {
-    freed,
-    busied_by_man,
-    busied_by_woman,
-    full
-} room_status;
-
-// Структура с данными о состоянии комнат.
-typedef struct {
-    room_status single_rooms[SINGLE_ROOMS_COUNT];
-    room_status double_rooms[DOUBLE_ROOMS_COUNT];
-} rooms_data_t;
-
-// Ожидает разблокировки семафора.
-void wait_semaphore(int sem_id) {
-    struct sembuf sem_op;
-    sem_op.sem_num = 0;
-    sem_op.sem_op = 0;
-    sem_op.sem_flg = 0;
-    semop(sem_id, &sem_op, 1);
-    semctl(sem_id, 0, SETVAL, 1);
-}
+#include "../common/hotel_checkouts.h"
+#include "../common/rooms_segment.h"
 
 // Общие переменные для работы программы.
 int rooms_fd;
-int rooms_semaphore_id;
-rooms_data_t *rooms_data;
+// Сегмент с состоянием комнат: заголовок, за которым следуют массивы номеров.
+rooms_header_t *rooms_data;
 
 // Освобождает занятые процессом ресурсы.
 void free_resources() {
-    semctl(rooms_semaphore_id, 0, IPC_RMID, 0);
     shmdt(rooms_data);
     exit(1);
 }
@@ -53,86 +28,80 @@ void handle_sigterm(__attribute__((unused)) int signal) {
 }
 
 int main(__attribute__((unused)) int argc, char *argv[]) {
+    // Строки журнала выводятся сразу, даже если вывод перенаправлен в канал, как в терминале.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
     int client_id = atoi(argv[1]);
     int client_gender = atoi(argv[2]);
     int client_rent_time = atoi(argv[3]);
     key_t shm_key = ftok("/tmp", 0x182003);
-    key_t sem_key = ftok("/tmp", 0x182004);
 
     // Инициализируем доступ к shared memory для работы с состояниями комнат.
-    rooms_fd = shmget(shm_key, sizeof(rooms_data_t), IPC_CREAT | 0666);
-    rooms_data = shmat(rooms_fd, NULL, 0);
-    rooms_semaphore_id = semget(sem_key, 1, IPC_CREAT | 0666);
-    signal(SIGTERM, handle_sigterm);
-
-    // Ищем свободную комнату, перед этим блокируем семафор.
-    wait_semaphore(rooms_semaphore_id);
-
-    // Теперь поищем нужный нам отель!
-    // Сначала проверим комнаты на одно спальное место.
-    int used_single_idx = -1;
-    int used_double_idx = -1;
-
-    for (int i = 0; i < SINGLE_ROOMS_COUNT; ++i) {
-        if (rooms_data->single_rooms[i] == freed) {
-            printf("[CLIENT-%d] rent single room: idx = %i.\n", client_id, i);
-            rooms_data->single_rooms[i] = full;
-            used_single_idx = i;
-            break;
-        }
+    // Сегмент подключается целиком, размер отеля клиент узнает из заголовка.
+    rooms_fd = shmget(shm_key, 0, 0666);
+    rooms_data = rooms_fd == -1 ? (void *) -1 : shmat(rooms_fd, NULL, 0);
+    if (rooms_data == (void *) -1 || !rooms_segment_is_valid(rooms_data)) {
+        printf("[CLIENT-%d] hotel is not running!\n", client_id);
+        return 1;
     }
 
-    // Если же не нашли на одно место, то поищем на два места, но при условии, либо комната пуста,
-    // либо в ней живет человек того же пола.
-    if (used_single_idx == -1) {
-        for (int i = 0; i < DOUBLE_ROOMS_COUNT; ++i) {
-            if (rooms_data->double_rooms[i] == freed) {
-                rooms_data->double_rooms[i] = client_gender == 0 ? busied_by_man : busied_by_woman;
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d.\n", client_id, i, client_gender);
-                used_double_idx = i;
-                break;
-            } else if ((rooms_data->double_rooms[i] == busied_by_man && client_gender == 0) ||
-                       (rooms_data->double_rooms[i] == busied_by_woman && client_gender == 1)) {
-                printf("[CLIENT-%d] rent double room: idx = %d, gender = %d, with_gender = %d.\n", client_id, i,
-                       client_gender, client_gender);
+    signal(SIGTERM, handle_sigterm);
 
-                rooms_data->double_rooms[i] = full;
-                used_double_idx = i;
-                break;
-            }
-        }
+    // Ищем свободную комнату: сначала в шарде клиента, затем в соседних. Сначала проверяются комнаты на одно
+    // спальное место, затем на два, но при условии, что комната пуста или в ней живет человек того же пола.
+    // Каждый шард на время поиска блокируется своим семафором System V (или блокировкой на futex в сегменте, если
+    // отель запущен с lock=futex), поэтому клиенты из разных шардов не ждут друг друга. В режиме CAS статусы номеров меняются атомарно, и блокировки не нужны.
+    // Время ожидания и удержания блокировок попадает в статистику отеля.
+    hotel_stats_t *stats = rooms_segment_stats(rooms_data);
+    // События клиента записываются в кольцо журнала в сегменте, а строки из них выводит отель.
+    event_log_t *log = rooms_segment_log(rooms_data);
+    rooms_booking_t booking;
+    rooms_waiter_t *waiter = NULL;
+    int booked = rooms_waitlist_book(rooms_data, client_id, client_gender, 1, &booking, &waiter);
+
+    // Если мест нет, клиент встает в лист ожидания (если он включен) и спит, пока отель не забронирует ему
+    // освободившийся номер.
+    if (booked == 1) {
+        event_log_write(log, log_client_waiting_room, client_id, 0, 0);
+        stats_count(&stats->waitlisted);
+        uint64_t wait_started_at = stats_now_ns();
+        booked = rooms_waitlist_wait(waiter, &booking);
+        stats_record(&stats->waitlist_wait, wait_started_at);
     }
 
-    // Разблокируем семафор, чтобы другой процесс забронировал комнату.
-    semctl(rooms_semaphore_id, 0, SETVAL, 0);
-
-    // Если нашли комнату, то значит, что статус мы изменили.
-    if (used_double_idx == -1 && used_single_idx == -1) {
-        printf("[CLIENT-%d] out of service!\n", client_id);
+    // Отказ клиенту из листа ожидания записывает в журнал отель, закрывая лист.
+    if (booked == -1) {
+        if (waiter == NULL) {
+            event_log_write(log, log_client_out_of_service, client_id, 0, 0);
+        }
+        stats_count(&stats->rejected);
         free_resources();
         return 0;
     }
 
-    // Бронируем комнату и ждем ...
-    printf("[CLIENT-%d] waiting %ds.\n", client_id, client_rent_time);
-    sleep(client_rent_time);
-
-    // Теперь освободим комнату.
-    wait_semaphore(rooms_semaphore_id);
+    int room_idx = rooms_booking_room(rooms_data, &booking);
+    if (!booking.is_double) {
+        event_log_write(log, log_client_rent_single, client_id, room_idx, 0);
+    } else if (booking.previous_status == freed) {
+        event_log_write(log, log_client_rent_double, client_id, room_idx, client_gender);
+    } else {
+        event_log_write(log, log_client_rent_double_shared, client_id, room_idx, client_gender);
+    }
 
-    if (used_double_idx >= 0) {
-        if (rooms_data->double_rooms[used_double_idx] == full) {
-            rooms_data->double_rooms[used_double_idx] = client_gender == 0 ? busied_by_man : busied_by_woman;
-        } else if (rooms_data->double_rooms[used_double_idx] == busied_by_man ||
-                   rooms_data->double_rooms[used_double_idx] == busied_by_woman) {
-            rooms_data->double_rooms[used_double_idx] = freed;
-        }
-    } else if (used_single_idx >= 0) {
-        rooms_data->single_rooms[used_single_idx] = freed;
+    // Бронируем комнату и ждем ...
+    stats_count(&stats->booked);
+    event_log_write(log, log_client_waiting_rent, client_id, client_rent_time, 0);
+    rooms_checkout_t checkout = {stats_now_ns() + (uint64_t) client_rent_time * 1000000000, client_id, client_gender,
+                                 booking};
+
+    // Номер по окончании аренды освобождает поток выездов отеля, а клиент сразу завершается. Аренда нулевой длины
+    // уже закончилась, и номер освобождается сразу.
+    if (client_rent_time == 0) {
+        hotel_checkouts_release(rooms_data, &checkout);
+    } else {
+        rooms_checkouts_push(rooms_data, &checkout);
     }
 
-    printf("[CLIENT-%d] end of rent!\n", client_id);
-    semctl(rooms_semaphore_id, 0, SETVAL, 0);
     free_resources();
     return 0;
 }
@@ -6,35 +6,40 @@
 #include <sys/sem.h>
 #include <sys/shm.h>
 
-#define SINGLE_ROOMS_COUNT 10
-#define DOUBLE_ROOMS_COUNT 15
-
-// Статус комнаты.
-typedef enum {
-    freed,
-    busied_by_man,
-    busied_by_woman,
-    full
-} room_status;
-
-// Структура с данными о состоянии комнат.
-typedef struct {
-    room_status single_rooms[SINGLE_ROOMS_COUNT];
-    room_status double_rooms[DOUBLE_ROOMS_COUNT];
-} rooms_data_t;
+#include "../common/hotel_checkouts.h"
+#include "../common/rooms_segment.h"
 
 // Общие переменные для работы программы.
 int rooms_fd;
-int rooms_semaphore_id;
-rooms_data_t *rooms_data;
+// Набор семафоров System V, по семафору на шард, или -1, если шарды защищают блокировки на futex.
+int rooms_semaphore_id = -1;
+// Сегмент с состоянием комнат: заголовок, за которым следуют массивы номеров.
+rooms_header_t *rooms_data;
+size_t rooms_data_size;
+// Фоновый писатель журнала клиентов.
+event_log_writer_t log_writer;
+// Поток выездов, освобождающий номера гостей по окончании аренды.
+hotel_checkouts_t checkouts;
+// Выставляется обработчиком SIGUSR1, статистику печатает основной цикл.
+volatile sig_atomic_t stats_requested;
 
 // Освобождает занятые процессом ресурсы.
 void free_resources() {
     printf("[HOTEL] Stopping ...\n");
 
-    // Освобождаем ресурсы.
-    semctl(rooms_semaphore_id, 0, IPC_RMID, 0);
+    // Останавливаем поток выездов: гости, чья аренда еще не закончилась, выезжают вместе с остановкой отеля, и строк
+    // о выезде для них в журнале нет.
+    hotel_checkouts_stop(&checkouts, 0);
+
+    // Будим клиентов из листа ожидания: номеров они уже не дождутся. Их отказы отель записывает в журнал сам, при
+    // закрытии листа, поэтому они попадают в остаток журнала, который выводится перед освобождением ресурсов.
+    rooms_waitlist_close(rooms_data);
+    event_log_writer_stop(&log_writer);
+    if (rooms_semaphore_id != -1) {
+        semctl(rooms_semaphore_id, 0, IPC_RMID, 0);
+    }
     shmdt(rooms_data);
+    shmctl(rooms_fd, IPC_RMID, NULL);
     exit(1);
 }
 
@@ -45,26 +50,89 @@ void handle_sigterm(__attribute__((unused)) int signal) {
     }
 }
 
-int main() {
+// Запрашивает печать статистики по сигналу SIGUSR1: kill -USR1 <pid>.
+void handle_sigusr1(__attribute__((unused)) int signal) {
+    stats_requested = 1;
+}
+
+int main(int argc, char *argv[]) {
+    // Строки журнала выводятся сразу, даже если вывод перенаправлен в канал, как в терминале.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Число номеров задается аргументами или файлом конфигурации, бронирование без блокировки (через
+    // compare-and-swap) включается аргументом "cas": ./hotel.out 1000 500 cas
+    rooms_config_t config;
+    if (rooms_config_parse(&config, argc, argv) == -1) {
+        return 1;
+    }
+
+    // Клиенты не ждут окончания аренды сами, а передают выезды отелю через очередь в сегменте.
+    config.hotel_checkouts = 1;
+
+    rooms_data_size = rooms_segment_size(&config);
+
     key_t shm_key = ftok("/tmp", 0x182003);
     key_t sem_key = ftok("/tmp", 0x182004);
 
-    // Открываем семафоры для первичной инициализации.
     // Инициализируем доступ к shared memory для работы с состояниями комнат.
-    rooms_fd = shmget(shm_key, sizeof(rooms_data_t), IPC_CREAT | 0666);
+    // Сегмент от предыдущего запуска мог иметь другой размер, поэтому сначала удаляем его.
+    rooms_fd = shmget(shm_key, 0, 0666);
+    if (rooms_fd != -1) {
+        shmctl(rooms_fd, IPC_RMID, NULL);
+    }
+
+    rooms_fd = shmget(shm_key, rooms_data_size, IPC_CREAT | 0666);
     rooms_data = shmat(rooms_fd, NULL, 0);
-    rooms_semaphore_id = semget(sem_key, 1, IPC_CREAT | 0666);
 
-    // Инициализируем состояние комнат.
-    memset(rooms_data->single_rooms, freed, sizeof(room_status) * SINGLE_ROOMS_COUNT);
-    memset(rooms_data->double_rooms, freed, sizeof(room_status) * DOUBLE_ROOMS_COUNT);
+    // Инициализируем состояние комнат и блокировку номеров в заголовке сегмента.
+    rooms_segment_init(rooms_data, &config);
+
+    // По-умолчанию шарды защищают семафоры System V: их захват за упавшего клиента отменяет ядро (SEM_UNDO).
+    // Аргумент lock=futex оставляет блокировки на futex в сегменте. Идентификатор набора клиенты берут из заголовка.
+    if (config.lock_kind != rooms_lock_futex) {
+        rooms_semaphore_id = semget(sem_key, 0, 0666);
+        if (rooms_semaphore_id != -1) {
+            semctl(rooms_semaphore_id, 0, IPC_RMID, 0);
+        }
+
+        rooms_semaphore_id = semget(sem_key, rooms_data->shards_count, IPC_CREAT | 0666);
+        if (rooms_semaphore_id == -1) {
+            perror("semget");
+            shmdt(rooms_data);
+            shmctl(rooms_fd, IPC_RMID, NULL);
+            return 1;
+        }
+
+        rooms_segment_use_sysv_locks(rooms_data, rooms_semaphore_id);
+    }
+
+    // Клиенты записывают события в кольцо журнала в сегменте, а строки из них выводит фоновый поток отеля.
+    event_log_writer_start(&log_writer, rooms_segment_log(rooms_data), STDOUT_FILENO);
+
+    // Номера гостей по окончании аренды освобождает поток выездов отеля.
+    if (hotel_checkouts_start(&checkouts, rooms_data, hotel_checkouts_release) == -1) {
+        perror("hotel_checkouts_start");
+        free_resources();
+    }
 
     printf("[HOTEL] Started state hosting.\n");
     signal(SIGTERM, handle_sigterm);
+    signal(SIGUSR1, handle_sigusr1);
     fflush(stdout);
 
-    // Ожидаем теперь SIGCONTINUE.
-    pause();
-    free_resources();
-    return 0;
+    // Ожидаем теперь SIGTERM, печатая статистику по каждому SIGUSR1. Вне sigsuspend сигнал SIGUSR1 заблокирован:
+    // пришедший во время печати будет доставлен при следующем ожидании, а не потеряется между проверкой и ожиданием.
+    sigset_t signals, previous_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &signals, &previous_signals);
+
+    while (1) {
+        sigsuspend(&previous_signals);
+
+        if (stats_requested) {
+            stats_requested = 0;
+            stats_print_stripes(stdout, &rooms_data->stats);
+        }
+    }
 }
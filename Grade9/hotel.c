@@ -2,58 +2,162 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/wait.h>
-#include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <time.h>
 
-#define SINGLE_ROOMS_COUNT 10
-#define DOUBLE_ROOMS_COUNT 15
-#define ROOMS_SEM_NAME "/rooms_sem18200345678"
-#define ROOMS_INPUT_NAME "/tmp/rooms_input23"
-#define ROOMS_OUTPUT_NAME "/tmp/rooms_output23"
-
-// Статус комнаты.
-typedef enum {
-    freed,
-    busied_by_man,
-    busied_by_woman,
-    full
-} room_status;
+#include "../common/io.h"
+#include "../common/journal.h"
 
-// Структура с данными о состоянии комнат.
-typedef struct {
-    room_status single_rooms[SINGLE_ROOMS_COUNT];
-    room_status double_rooms[DOUBLE_ROOMS_COUNT];
-} rooms_data_t;
+#define ROOMS_INPUT_NAME "/tmp/rooms_input23"
+#define ROOMS_CONTROL_NAME "/tmp/rooms_control23"
+#define ROOMS_REPLY_NAME "/tmp/rooms_reply23_%d"
+#define ROOMS_STATS_NAME "/rooms_stats23"
+#define REQUESTS_BATCH_SIZE 256
+#define EVENTS_COUNT 8
+// Сколько каналов ответов клиентов отель держит открытыми одновременно.
+#define REPLY_CHANNELS_COUNT 256
+// Признак события epoll от канала ответов: в младших 32 битах лежит идентификатор канала, а не дескриптор.
+#define REPLY_EVENT_TAG (1ULL << 32)
 
-// Структура с данными сообщения
+// Канал ответов клиента, открытый отелем.
 typedef struct {
-    int packet_id;
-    rooms_data_t data;
-} message_t;
+    int32_t reply_id;
+    int fd;
+} reply_channel_t;
 
 // Общие переменные для работы программы.
 int rooms_input_fd;
-int rooms_output_fd;
-message_t *input_buffer;
-rooms_data_t *rooms_data;
-sem_t *rooms_semaphore;
+int rooms_control_fd;
+int epoll_fd;
+// Таймер срабатывает к ближайшему окончанию аренды.
+int checkout_timer_fd;
+// Распределитель номеров: состояние комнат и бронирования клиентов живут только в процессе отеля.
+hotel_engine_t engine;
+// Счетчики работы отеля в shared memory: время обмена с отелем в них добавляют клиенты.
+hotel_stats_stripes_t *stats;
+// Журнал заселений и выездов на диске, если отель запущен с аргументом journal=файл.
+journal_t journal;
+// События клиентов основной цикл записывает в кольцо журнала, а строки из них выводит фоновый поток.
+event_log_t *client_log;
+event_log_writer_t log_writer;
+// Выставляется обработчиком SIGUSR1, статистику печатает основной цикл.
+volatile sig_atomic_t stats_requested;
+// Открытые каналы ответов. Ячейка канала выбирается по его идентификатору, свободная ячейка хранит fd = -1.
+reply_channel_t reply_channels[REPLY_CHANNELS_COUNT];
+
+// Закрывает канал ответов в ячейке slot. Закрытый дескриптор epoll забывает сам.
+void close_reply_channel(int slot) {
+    if (reply_channels[slot].fd != -1) {
+        close(reply_channels[slot].fd);
+        reply_channels[slot].fd = -1;
+    }
+}
+
+// Возвращает ячейку канала ответов клиента, открывая канал при первом ответе ему. Открытый канал отель держит, пока
+// клиент не закроет свой конец или ячейку не займет другой клиент, поэтому следующие ответы тому же клиенту обходятся
+// одним write. Клиент открывает свой канал до отправки запроса, поэтому открытие не блокируется.
+// Возвращает -1, если канала уже нет.
+int open_reply_channel(int32_t reply_id) {
+    int slot = (int) ((uint32_t) reply_id % REPLY_CHANNELS_COUNT);
+    reply_channel_t *channel = &reply_channels[slot];
+
+    if (channel->fd != -1 && channel->reply_id == reply_id) {
+        return slot;
+    }
+
+    close_reply_channel(slot);
+
+    char reply_name[64];
+    snprintf(reply_name, sizeof(reply_name), ROOMS_REPLY_NAME, reply_id);
+    int reply_fd = open(reply_name, O_WRONLY | O_NONBLOCK);
+    if (reply_fd == -1) {
+        return -1;
+    }
+
+    // Когда клиент закрывает свой конец канала, epoll сообщает об ошибке на нашем конце: подписываться на нее
+    // не нужно, она приходит всегда.
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.data.u64 = REPLY_EVENT_TAG | (uint32_t) reply_id;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, reply_fd, &event);
+
+    channel->reply_id = reply_id;
+    channel->fd = reply_fd;
+    return slot;
+}
+
+// Закрывает канал ответов клиента, который закрыл свой конец. Ячейку мог уже занять другой клиент, тогда ее канал
+// остается открытым.
+void handle_reply_hangup(int32_t reply_id) {
+    int slot = (int) ((uint32_t) reply_id % REPLY_CHANNELS_COUNT);
+
+    if (reply_channels[slot].reply_id == reply_id) {
+        close_reply_channel(slot);
+    }
+}
+
+// Отправляет ответ в канал клиента. Если клиент уже завершился, ответ просто отбрасывается. Канал, оставшийся от
+// завершившегося клиента, pid которого достался новому, отвечает EPIPE: тогда канал открывается заново по имени.
+void send_reply(const hotel_request_t *request, const hotel_reply_t *reply) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int slot = open_reply_channel(request->reply_id);
+
+        if (slot == -1 || write_full(reply_channels[slot].fd, reply, sizeof(hotel_reply_t)) == 0 || errno != EPIPE) {
+            return;
+        }
+
+        close_reply_channel(slot);
+    }
+}
+
+// Возвращает текущее время монотонных часов в миллисекундах.
+int64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Взводит таймер на ближайший запланированный выезд или останавливает его, если выездов нет.
+void arm_checkout_timer() {
+    struct itimerspec timer;
+    int64_t expires_at = hotel_engine_next_checkout(&engine);
+
+    memset(&timer, 0, sizeof(timer));
+    if (expires_at != -1) {
+        // Нулевое значение остановило бы таймер, поэтому берем хотя бы одну миллисекунду.
+        expires_at = expires_at > 0 ? expires_at : 1;
+        timer.it_value.tv_sec = expires_at / 1000;
+        timer.it_value.tv_nsec = (expires_at % 1000) * 1000000;
+    }
+
+    timerfd_settime(checkout_timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+}
 
 // Освобождает занятые процессом ресурсы.
 void free_resources() {
     printf("[HOTEL] Stopping ...\n");
 
     // Освобождаем ресурсы.
+    close(epoll_fd);
+    close(checkout_timer_fd);
     close(rooms_input_fd);
-    close(rooms_output_fd);
-    sem_close(rooms_semaphore);
-    sem_unlink(ROOMS_SEM_NAME);
-    sem_destroy(rooms_semaphore);
-    free(input_buffer);
-    free(rooms_data);
-    unlink(ROOMS_OUTPUT_NAME);
+    close(rooms_control_fd);
+    for (int i = 0; i < REPLY_CHANNELS_COUNT; ++i) {
+        close_reply_channel(i);
+    }
+    hotel_engine_free(&engine);
+    journal_close(&journal);
+    event_log_writer_stop(&log_writer);
+    free(client_log);
+    munmap(stats, sizeof(hotel_stats_stripes_t));
+    shm_unlink(ROOMS_STATS_NAME);
     unlink(ROOMS_INPUT_NAME);
+    unlink(ROOMS_CONTROL_NAME);
     exit(1);
 }
 
@@ -64,35 +168,256 @@ void handle_sigterm(__attribute__((unused)) int signal) {
     }
 }
 
-int main() {
+// Запрашивает печать статистики по сигналу SIGUSR1: kill -USR1 <pid>.
+void handle_sigusr1(__attribute__((unused)) int signal) {
+    stats_requested = 1;
+}
+
+// Учитывает в статистике результат выполненного запроса.
+void count_request(const hotel_request_t *request, const hotel_reply_t *reply) {
+    if (request->packet_id == packet_book) {
+        stats_count(reply->result == 0 ? &stats_stripe(stats, 0)->booked : &stats_stripe(stats, 0)->rejected);
+    } else if (request->packet_id == packet_release && reply->result == 0) {
+        stats_count(&stats_stripe(stats, 0)->released);
+    }
+}
+
+// Дописывает событие в журнал, если он ведется.
+void write_journal(journal_event event, int32_t client_id, int32_t gender, int32_t is_double, int32_t room_idx,
+                   int32_t rent_ms) {
+    if (journal.header == NULL) {
+        return;
+    }
+
+    journal_record_t record = {journal_now_ms(), event, client_id, gender, is_double, room_idx, rent_ms};
+    if (journal_append(&journal, &record) == -1) {
+        perror("journal_append");
+    }
+}
+
+// Записывает в журнал результат выполненного запроса: заселение, отказ или выезд. Срок аренды пишется только для
+// заселения: его отель уже проверил, и в миллисекундах он помещается в int32_t.
+void journal_request(const hotel_request_t *request, const hotel_reply_t *reply) {
+    if (request->packet_id == packet_book && reply->result == 0) {
+        write_journal(journal_book, request->client_id, request->gender, reply->is_double, reply->room_idx,
+                      request->rent_time * 1000);
+    } else if (request->packet_id == packet_book) {
+        write_journal(journal_reject, request->client_id, request->gender, reply->is_double, reply->room_idx, 0);
+    } else if (request->packet_id == packet_release && reply->result == 0) {
+        write_journal(journal_release, request->client_id, request->gender, reply->is_double, reply->room_idx, 0);
+    }
+}
+
+// Записывает в журнал клиентов результат выполненного запроса теми же строками, что раньше печатали сами клиенты.
+void log_request(const hotel_request_t *request, const hotel_reply_t *reply) {
+    int client_id = request->client_id;
+
+    if (request->packet_id == packet_book && reply->result == 0) {
+        if (!reply->is_double) {
+            event_log_write(client_log, log_client_rent_single, client_id, reply->room_idx, 0);
+        } else if (reply->previous_status == freed) {
+            event_log_write(client_log, log_client_rent_double, client_id, reply->room_idx, request->gender);
+        } else {
+            event_log_write(client_log, log_client_rent_double_shared, client_id, reply->room_idx, request->gender);
+        }
+        event_log_write(client_log, log_client_waiting_rent, client_id, request->rent_time, 0);
+    } else if (request->packet_id == packet_book) {
+        event_log_write(client_log, log_client_out_of_service, client_id, 0, 0);
+    } else if (request->packet_id == packet_release && reply->result == 0) {
+        event_log_write(client_log, log_client_end_of_rent, client_id, 0, 0);
+    }
+}
+
+// Восстанавливает заселения из журнала прежнего запуска. Гости, срок аренды которых истек, пока отель не работал,
+// выселяются при первом срабатывании таймера.
+void restore_journal() {
+    int64_t now = monotonic_ms();
+    int64_t now_real = journal_now_ms();
+    uint64_t count = journal.header->records_count;
+    uint64_t errors = 0;
+
+    if (count == 0) {
+        return;
+    }
+
+    for (uint64_t i = 0; i < count; ++i) {
+        errors += journal_apply(&engine, &journal_records(&journal)[i], now, now_real) == -1;
+    }
+
+    printf("[HOTEL] Restored %d guests from %llu journal records.\n", engine.bookings_count,
+           (unsigned long long) count);
+
+    // Запись, противоречащая состоянию номеров, означает испорченный журнал: она пропускается, а не ломает отель.
+    if (errors != 0) {
+        printf("[HOTEL] Skipped %llu inconsistent journal records.\n", (unsigned long long) errors);
+    }
+}
+
+// Забирает из канала все накопившиеся запросы пачками, применяет каждую пачку к состоянию комнат
+// и только потом подряд рассылает ответы в уже открытые каналы клиентов. Канал неблокирующий, поэтому цикл заканчивается, как только он опустеет.
+void handle_requests() {
+    hotel_request_t requests[REQUESTS_BATCH_SIZE];
+    hotel_reply_t replies[REQUESTS_BATCH_SIZE];
+    int replies_needed[REQUESTS_BATCH_SIZE];
+    ssize_t requests_count;
+    int64_t now = monotonic_ms();
+
+    while ((requests_count = read_records(rooms_input_fd, requests, sizeof(hotel_request_t),
+                                          REQUESTS_BATCH_SIZE)) > 0) {
+        for (ssize_t i = 0; i < requests_count; ++i) {
+            replies_needed[i] = hotel_engine_handle(&engine, &requests[i], &replies[i], now);
+            count_request(&requests[i], &replies[i]);
+            journal_request(&requests[i], &replies[i]);
+            log_request(&requests[i], &replies[i]);
+        }
+
+        for (ssize_t i = 0; i < requests_count; ++i) {
+            if (replies_needed[i]) {
+                send_reply(&requests[i], &replies[i]);
+            }
+        }
+    }
+}
+
+// Выселяет гостей, срок аренды которых истек.
+void handle_checkouts() {
+    uint64_t expirations;
+    hotel_booking_t booking;
+    int64_t now = monotonic_ms();
+
+    read(checkout_timer_fd, &expirations, sizeof(expirations));
+
+    while (hotel_engine_expire(&engine, now, &booking)) {
+        event_log_write(client_log, log_client_end_of_rent, booking.client_id, 0, 0);
+        write_journal(journal_checkout, booking.client_id, booking.gender, booking.is_double, booking.room_idx, 0);
+        stats_count(&stats_stripe(stats, 0)->released);
+    }
+}
+
+// Выполняет команды администратора из управляющего канала: "status" печатает число гостей, "stats" - статистику,
+// "stop" завершает отель.
+void handle_control() {
+    char buffer[256];
+    ssize_t size = read(rooms_control_fd, buffer, sizeof(buffer) - 1);
+
+    if (size <= 0) {
+        return;
+    }
+
+    buffer[size] = '\0';
+
+    for (char *command = strtok(buffer, "\n"); command != NULL; command = strtok(NULL, "\n")) {
+        if (strcmp(command, "status") == 0) {
+            printf("[HOTEL] guests = %d, single rooms = %d, double rooms = %d.\n", engine.bookings_count,
+                   engine.rooms->single_rooms_count, engine.rooms->double_rooms_count);
+        } else if (strcmp(command, "stats") == 0) {
+            stats_print_stripes(stdout, stats);
+        } else if (strcmp(command, "stop") == 0) {
+            free_resources();
+        }
+    }
+}
+
+// Добавляет дескриптор в набор, за которым следит epoll.
+void watch_descriptor(int fd) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int main(int argc, char *argv[]) {
+    // Строки журнала выводятся сразу, даже если вывод перенаправлен в канал, как в терминале.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // Число номеров задается аргументами или файлом конфигурации.
+    rooms_config_t config;
+    if (rooms_config_parse(&config, argc, argv) == -1) {
+        return 1;
+    }
+
     mkfifo(ROOMS_INPUT_NAME, 0666);
-    mkfifo(ROOMS_OUTPUT_NAME, 0666);
+    mkfifo(ROOMS_CONTROL_NAME, 0666);
+
+    // Открываем неблокирующие каналы запросов и команд. Ответы отель пишет в каналы клиентов.
+    rooms_input_fd = open(ROOMS_INPUT_NAME, O_RDWR | O_NONBLOCK);
+    rooms_control_fd = open(ROOMS_CONTROL_NAME, O_RDWR | O_NONBLOCK);
+    epoll_fd = epoll_create1(0);
+    for (int i = 0; i < REPLY_CHANNELS_COUNT; ++i) {
+        reply_channels[i].fd = -1;
+    }
+    watch_descriptor(rooms_input_fd);
+    watch_descriptor(rooms_control_fd);
 
-    // Открываем дескрипторы для чтения и записи
-    rooms_semaphore = sem_open(ROOMS_SEM_NAME, O_CREAT | O_EXCL, 0644, 1);
-    rooms_output_fd = open(ROOMS_OUTPUT_NAME, O_RDWR);
-    rooms_input_fd = open(ROOMS_INPUT_NAME, O_RDWR);
-    input_buffer = malloc(sizeof(message_t));
+    // Выезды гостей планирует сам отель, поэтому клиентам не нужно ждать окончания аренды.
+    checkout_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    watch_descriptor(checkout_timer_fd);
 
     // Инициализируем состояние комнат.
-    rooms_data = malloc(sizeof(rooms_data_t));
-    memset(rooms_data->single_rooms, freed, sizeof(room_status) * SINGLE_ROOMS_COUNT);
-    memset(rooms_data->double_rooms, freed, sizeof(room_status) * DOUBLE_ROOMS_COUNT);
+    if (hotel_engine_init(&engine, &config) == -1) {
+        perror("hotel_engine_init");
+        free_resources();
+    }
+
+    // Статистику отель держит в shared memory, чтобы ее могли пополнять клиенты.
+    int stats_fd = shm_open(ROOMS_STATS_NAME, O_RDWR | O_CREAT, 0666);
+    ftruncate(stats_fd, sizeof(hotel_stats_stripes_t));
+    stats = mmap(NULL, sizeof(hotel_stats_stripes_t), PROT_READ | PROT_WRITE, MAP_SHARED, stats_fd, 0);
+    close(stats_fd);
+    if (stats == MAP_FAILED) {
+        perror("stats == MAP_FAILED");
+        free_resources();
+    }
+
+    memset(stats, 0, sizeof(hotel_stats_stripes_t));
+
+    // Журнал отображается в память и дописывается без системных вызовов. Если он остался от прежнего запуска с тем
+    // же числом номеров, отель продолжает его и восстанавливает заселения.
+    if (config.journal_path != NULL) {
+        if (journal_open(&journal, config.journal_path, config.single_rooms_count, config.double_rooms_count) == -1) {
+            perror("journal_open");
+            free_resources();
+        }
+
+        restore_journal();
+        arm_checkout_timer();
+    }
+
+    // Строки журнала клиентов выводит фоновый поток, поэтому основной цикл не ждет stdout. Клиенты сами ничего не
+    // печатают: все события их запросов видит отель.
+    client_log = event_log_create(rooms_config_log_capacity(&config), config.log_level, config.log_time);
+    event_log_writer_start(&log_writer, client_log, STDOUT_FILENO);
+
     printf("[HOTEL] Started state hosting.\n");
     signal(SIGTERM, handle_sigterm);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGUSR1, handle_sigusr1);
+
+    // Запросы и ответы занимают несколько байт и меньше PIPE_BUF, поэтому запись в канал атомарна.
+    // Отель ждет событий сразу на всех своих каналах и таймере выездов и обрабатывает те, что сработали.
+    struct epoll_event events[EVENTS_COUNT];
 
     while (1) {
-        read(rooms_input_fd, input_buffer, sizeof(message_t));
+        int events_count = epoll_wait(epoll_fd, events, EVENTS_COUNT, -1);
 
-        if (input_buffer->packet_id == 2) {
-            for (int i = 0; i < SINGLE_ROOMS_COUNT; ++i) {
-                rooms_data->single_rooms[i] = input_buffer->data.single_rooms[i];
-            }
-            for (int i = 0; i < DOUBLE_ROOMS_COUNT; ++i) {
-                rooms_data->double_rooms[i] = input_buffer->data.double_rooms[i];
+        for (int i = 0; i < events_count; ++i) {
+            if (events[i].data.u64 & REPLY_EVENT_TAG) {
+                handle_reply_hangup((int32_t) (uint32_t) events[i].data.u64);
+            } else if (events[i].data.fd == rooms_input_fd) {
+                handle_requests();
+            } else if (events[i].data.fd == rooms_control_fd) {
+                handle_control();
+            } else if (events[i].data.fd == checkout_timer_fd) {
+                handle_checkouts();
             }
         }
 
-        write(rooms_output_fd, rooms_data, sizeof(rooms_data_t));
+        if (stats_requested) {
+            stats_requested = 0;
+            stats_print_stripes(stdout, stats);
+        }
+
+        arm_checkout_timer();
     }
 }
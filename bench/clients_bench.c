@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../common/clients.h"
+
+#define TEXT_TRACE_NAME "/tmp/hw2_clients_bench.txt"
+#define BINARY_TRACE_NAME "/tmp/hw2_clients_bench.bin"
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Записывает случайную трассу в текстовом формате и преобразует ее в двоичный.
+static void write_traces(int count) {
+    FILE *text = fopen(TEXT_TRACE_NAME, "w");
+    clients_trace_t trace;
+    srand(42);
+
+    for (int i = 0; i < count; ++i) {
+        fprintf(text, "%d %d %d\n", i + 1, rand() % 2, rand() % 30);
+    }
+
+    fclose(text);
+    clients_load(&trace, TEXT_TRACE_NAME);
+    clients_save_binary(&trace, BINARY_TRACE_NAME, clients_min_rent_time_width(&trace));
+    clients_free(&trace);
+}
+
+// Читает трассу через fscanf, как это делали программы на 4-6 баллов. Возвращает число записей.
+static int load_with_fscanf() {
+    FILE *file = fopen(TEXT_TRACE_NAME, "r");
+    client_record_t record;
+    int count = 0;
+
+    while (fscanf(file, "%d %d %d", &record.id, &record.gender, &record.rent_time) == 3) {
+        count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+// Загружает трассу через clients_load и возвращает число записей.
+static int load_with_mmap(const char *path) {
+    clients_trace_t trace;
+    clients_load(&trace, path);
+    int count = trace.count;
+    clients_free(&trace);
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    // Число клиентов в трассе можно передать аргументом: ./clients_bench 10000000
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    write_traces(count);
+
+    double started_at = now_seconds();
+    int fscanf_count = load_with_fscanf();
+    double fscanf_time = now_seconds() - started_at;
+
+    started_at = now_seconds();
+    int text_count = load_with_mmap(TEXT_TRACE_NAME);
+    double text_time = now_seconds() - started_at;
+
+    started_at = now_seconds();
+    int binary_count = load_with_mmap(BINARY_TRACE_NAME);
+    double binary_time = now_seconds() - started_at;
+
+    printf("%10s %12s %12s %12s\n", "clients", "fscanf, ms", "text, ms", "binary, ms");
+    printf("%10d %12.1f %12.1f %12.1f\n", count, fscanf_time * 1e3, text_time * 1e3, binary_time * 1e3);
+
+    unlink(TEXT_TRACE_NAME);
+    unlink(BINARY_TRACE_NAME);
+    return fscanf_count == count && text_count == count && binary_count == count ? 0 : 1;
+}
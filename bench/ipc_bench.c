@@ -0,0 +1,406 @@
+#define _GNU_SOURCE
+
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "../common/workload.h"
+
+#define TRACE_NAME "/tmp/hw2_ipc_bench.bin"
+#define OUTPUT_BUFFER_SIZE 65536
+#define FIRST_GRADE 4
+#define LAST_GRADE 10
+
+extern char **environ;
+
+// Параметры бенчмарка, задаются аргументами запуска.
+typedef struct {
+    int grades[LAST_GRADE + 1];
+    workload_config_t workload;
+    int single_rooms_count;
+    int double_rooms_count;
+    int jobs;
+    const char *threads;
+    int use_cas;
+    char bin_dir[512];
+} bench_config_t;
+
+// Результаты прогона одной программы. Латентность бронирования считается от запуска клиента до его строки
+// "rent ..." или "out of service!". Программы запускаются с аргументом log_time и печатают перед каждой строкой момент
+// события (на 9-10 баллов - момент, когда отель обработал запрос), так что время доставки строки в латентность
+// не входит.
+typedef struct {
+    int64_t *started_at;
+    double *latencies;
+    int latencies_count;
+    int booked_count;
+    int rejected_count;
+    int64_t first_started_at;
+    int64_t last_booked_at;
+    int clients_count;
+    int hotel_ready;
+    // Канал, в который пишут все запущенные программы.
+    int output_fd;
+    int output_write_fd;
+    char buffer[OUTPUT_BUFFER_SIZE];
+    size_t buffered;
+} bench_run_t;
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Записывает двоичную трассу клиентов с заданными параметрами.
+static int write_trace(const bench_config_t *config) {
+    clients_trace_t trace;
+
+    if (workload_generate(&config->workload, &trace) == -1) {
+        return -1;
+    }
+
+    int result = clients_save_binary(&trace, TRACE_NAME, clients_min_rent_time_width(&trace));
+    clients_free(&trace);
+    return result;
+}
+
+// Разбирает строку, напечатанную отелем или клиентом. now - момент, когда строка прочитана из канала: он
+// используется, только если строка не начинается с момента события по часам клиента.
+static void handle_line(bench_run_t *run, const char *line, int64_t now) {
+    int client_id;
+    char event[16];
+    unsigned long long seconds, nanoseconds;
+    int prefix_length = 0;
+
+    // Часы клиентов и бенчмарка одни и те же (CLOCK_MONOTONIC), поэтому моменты можно сравнивать.
+    if (sscanf(line, "[%llu.%llu] %n", &seconds, &nanoseconds, &prefix_length) == 2 && prefix_length > 0) {
+        now = (int64_t) (seconds * 1000000000 + nanoseconds);
+        line += prefix_length;
+    }
+
+    if (strncmp(line, "[HOTEL] Started", 15) == 0) {
+        run->hotel_ready = 1;
+        return;
+    }
+
+    if (sscanf(line, "[CLIENT-%d] %15s", &client_id, event) != 2 || client_id < 1 ||
+        client_id > run->clients_count) {
+        return;
+    }
+
+    int64_t *started_at = &run->started_at[client_id - 1];
+
+    if (strcmp(event, "started.") == 0) {
+        *started_at = now;
+    } else if ((strcmp(event, "rent") == 0 || strcmp(event, "out") == 0) && *started_at != 0) {
+        run->latencies[run->latencies_count++] = (double) (now - *started_at) / 1e3;
+        run->booked_count += event[0] == 'r';
+        run->rejected_count += event[0] == 'o';
+        run->last_booked_at = now;
+        *started_at = 0;
+    }
+}
+
+// Читает вывод программ, пока он есть, ожидая его не дольше timeout_ms. Возвращает 0, если вывода не было.
+static int drain_output(bench_run_t *run, int timeout_ms) {
+    struct pollfd pollfd = {run->output_fd, POLLIN, 0};
+
+    if (poll(&pollfd, 1, timeout_ms) <= 0) {
+        return 0;
+    }
+
+    ssize_t count = read(run->output_fd, run->buffer + run->buffered, OUTPUT_BUFFER_SIZE - run->buffered - 1);
+    if (count <= 0) {
+        return 0;
+    }
+
+    int64_t now = now_ns();
+    run->buffered += (size_t) count;
+    run->buffer[run->buffered] = '\0';
+
+    char *line = run->buffer;
+    char *end;
+
+    while ((end = strchr(line, '\n')) != NULL) {
+        *end = '\0';
+        handle_line(run, line, now);
+        line = end + 1;
+    }
+
+    // Недописанная строка переносится в начало буфера.
+    run->buffered = strlen(line);
+    memmove(run->buffer, line, run->buffered);
+    return 1;
+}
+
+// Запускает программу, направляя ее вывод в общий канал бенчмарка. Возвращает pid или -1.
+static pid_t spawn(const bench_run_t *run, char *const argv[]) {
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, run->output_write_fd, STDOUT_FILENO);
+    int result = posix_spawn(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    return result == 0 ? pid : -1;
+}
+
+// Прогоняет трассу через программу на 4-6 баллов: она сама запускает клиентов и завершается, обслужив всех.
+static int run_driver(const bench_config_t *config, bench_run_t *run, int grade) {
+    char path[600], single[16], double_rooms[16], threads[32];
+    char *argv[] = {path, single, double_rooms, "clients=" TRACE_NAME, "log_time", NULL, NULL};
+
+    snprintf(path, sizeof(path), "%s/HW2_Grade%d", config->bin_dir, grade);
+    snprintf(single, sizeof(single), "%d", config->single_rooms_count);
+    snprintf(double_rooms, sizeof(double_rooms), "%d", config->double_rooms_count);
+    if (config->threads != NULL) {
+        snprintf(threads, sizeof(threads), "threads=%s", config->threads);
+        argv[5] = threads;
+    }
+
+    pid_t pid = spawn(run, argv);
+    if (pid == -1) {
+        return -1;
+    }
+
+    while (waitpid(pid, NULL, WNOHANG) == 0) {
+        drain_output(run, 10);
+    }
+
+    while (drain_output(run, 0)) {
+    }
+
+    return 0;
+}
+
+// Прогоняет трассу через отель и клиентов на 7-10 баллов: бенчмарк запускает клиентов сам, не больше jobs сразу
+// и не раньше их момента прибытия.
+static int run_hotel(const bench_config_t *config, bench_run_t *run, int grade) {
+    char hotel_path[600], client_path[600], single[16], double_rooms[16];
+    char *hotel_argv[] = {hotel_path, single, double_rooms, NULL, NULL, NULL};
+    int hotel_argc = 3;
+
+    // Строки клиентов выводит писатель журнала в отеле.
+    hotel_argv[hotel_argc++] = "log_time";
+    if (config->use_cas) {
+        hotel_argv[hotel_argc++] = "cas";
+    }
+
+    snprintf(hotel_path, sizeof(hotel_path), "%s/HW2_Grade%d_Hotel", config->bin_dir, grade);
+    snprintf(client_path, sizeof(client_path), "%s/HW2_Grade%d_Client", config->bin_dir, grade);
+    snprintf(single, sizeof(single), "%d", config->single_rooms_count);
+    snprintf(double_rooms, sizeof(double_rooms), "%d", config->double_rooms_count);
+
+    clients_trace_t trace;
+    if (clients_load(&trace, TRACE_NAME) == -1) {
+        return -1;
+    }
+
+    pid_t hotel_pid = spawn(run, hotel_argv);
+    if (hotel_pid == -1) {
+        clients_free(&trace);
+        return -1;
+    }
+
+    while (!run->hotel_ready && waitpid(hotel_pid, NULL, WNOHANG) == 0) {
+        drain_output(run, 10);
+    }
+
+    int running = 0;
+    int launched = 0;
+    run->first_started_at = now_ns();
+
+    while (run->hotel_ready && (launched < trace.count || running > 0)) {
+        int64_t elapsed_ms = (now_ns() - run->first_started_at) / 1000000;
+
+        if (launched < trace.count && running < config->jobs && clients_arrival(&trace, launched) <= elapsed_ms) {
+            char id[16], gender[16], rent_time[16];
+            char *client_argv[] = {client_path, id, gender, rent_time, NULL};
+            client_record_t record;
+
+            clients_get(&trace, launched++, &record);
+            snprintf(id, sizeof(id), "%d", record.id);
+            snprintf(gender, sizeof(gender), "%d", record.gender);
+            snprintf(rent_time, sizeof(rent_time), "%d", record.rent_time);
+
+            // Клиенты с номерами вне трассы в латентность не попадают.
+            if (record.id >= 1 && record.id <= run->clients_count) {
+                run->started_at[record.id - 1] = now_ns();
+            }
+            running += spawn(run, client_argv) != -1;
+            drain_output(run, 0);
+        } else {
+            drain_output(run, 1);
+        }
+
+        // Отель не завершается сам, поэтому его завершение означает ошибку.
+        pid_t pid;
+        while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+            if (pid == hotel_pid) {
+                run->hotel_ready = 0;
+            } else {
+                running--;
+            }
+        }
+    }
+
+    while (drain_output(run, 0)) {
+    }
+
+    kill(hotel_pid, SIGTERM);
+    waitpid(hotel_pid, NULL, 0);
+    while (waitpid(-1, NULL, 0) > 0) {
+    }
+
+    // Строки клиентов выводит писатель журнала в отеле, последние из них приходят уже при его остановке.
+    while (drain_output(run, 0)) {
+    }
+
+    clients_free(&trace);
+    return run->hotel_ready ? 0 : -1;
+}
+
+static int compare_doubles(const void *left, const void *right) {
+    double difference = *(const double *) left - *(const double *) right;
+    return (difference > 0) - (difference < 0);
+}
+
+// Возвращает перцентиль отсортированных значений.
+static double percentile(const double *values, int count, double fraction) {
+    if (count == 0) {
+        return 0;
+    }
+
+    int idx = (int) (fraction * (count - 1) + 0.5);
+    return values[idx];
+}
+
+static double cpu_ms(const struct rusage *usage) {
+    return (double) (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1e3 +
+           (double) (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1e3;
+}
+
+// Прогоняет трассу через программу на оценку grade и печатает строку результатов.
+static void bench_grade(const bench_config_t *config, int grade) {
+    int pipe_fds[2];
+    struct rusage usage_before, usage_after;
+    bench_run_t *run = calloc(1, sizeof(bench_run_t));
+
+    run->started_at = calloc((size_t) config->workload.clients_count, sizeof(int64_t));
+    run->latencies = malloc(sizeof(double) * (size_t) config->workload.clients_count);
+    // Запущенным программам достается только дескриптор записи, подставленный вместо stdout.
+    pipe2(pipe_fds, O_CLOEXEC);
+    run->output_fd = pipe_fds[0];
+    run->output_write_fd = pipe_fds[1];
+    run->clients_count = config->workload.clients_count;
+
+    getrusage(RUSAGE_CHILDREN, &usage_before);
+    run->first_started_at = now_ns();
+    int result = grade <= 6 ? run_driver(config, run, grade) : run_hotel(config, run, grade);
+    getrusage(RUSAGE_CHILDREN, &usage_after);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    if (result == -1) {
+        printf("%5d  failed to run\n", grade);
+    } else {
+        double seconds = (double) (run->last_booked_at - run->first_started_at) / 1e9;
+        qsort(run->latencies, (size_t) run->latencies_count, sizeof(double), compare_doubles);
+        printf("%5d %8d %8d %12.0f %10.1f %10.1f %10.1f %10.1f\n", grade, run->booked_count, run->rejected_count,
+               seconds > 0 ? run->latencies_count / seconds : 0,
+               percentile(run->latencies, run->latencies_count, 0.5),
+               percentile(run->latencies, run->latencies_count, 0.99),
+               percentile(run->latencies, run->latencies_count, 0.999),
+               cpu_ms(&usage_after) - cpu_ms(&usage_before));
+    }
+
+    free(run->started_at);
+    free(run->latencies);
+    free(run);
+}
+
+// Разбирает аргументы вида name=value. Возвращает -1, если аргумент неизвестен.
+static int parse_config(bench_config_t *config, int argc, char *argv[]) {
+    memset(config, 0, sizeof(bench_config_t));
+    workload_config_init(&config->workload);
+    config->single_rooms_count = 10;
+    config->double_rooms_count = 15;
+    config->jobs = 64;
+
+    // По-умолчанию программы ищутся рядом с бенчмарком.
+    const char *slash = strrchr(argv[0], '/');
+    snprintf(config->bin_dir, sizeof(config->bin_dir), "%.*s", slash != NULL ? (int) (slash - argv[0]) : 1,
+             slash != NULL ? argv[0] : ".");
+
+    for (int i = 1; i < argc; ++i) {
+        char *value = strchr(argv[i], '=');
+        value = value != NULL ? value + 1 : "";
+
+        if (strncmp(argv[i], "grades=", 7) == 0) {
+            for (char *grade = strtok(value, ","); grade != NULL; grade = strtok(NULL, ",")) {
+                int number = atoi(grade);
+                if (number >= FIRST_GRADE && number <= LAST_GRADE) {
+                    config->grades[number] = 1;
+                }
+            }
+        } else if (workload_parse_argument(&config->workload, argv[i]) == 0) {
+            continue;
+        } else if (strncmp(argv[i], "single=", 7) == 0) {
+            config->single_rooms_count = atoi(value);
+        } else if (strncmp(argv[i], "double=", 7) == 0) {
+            config->double_rooms_count = atoi(value);
+        } else if (strncmp(argv[i], "jobs=", 5) == 0) {
+            config->jobs = atoi(value) > 0 ? atoi(value) : 1;
+        } else if (strncmp(argv[i], "threads=", 8) == 0) {
+            config->threads = value;
+        } else if (strcmp(argv[i], "cas") == 0) {
+            config->use_cas = 1;
+        } else if (strncmp(argv[i], "bin=", 4) == 0) {
+            snprintf(config->bin_dir, sizeof(config->bin_dir), "%s", value);
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    int any_grade = 0;
+    for (int grade = FIRST_GRADE; grade <= LAST_GRADE; ++grade) {
+        any_grade |= config->grades[grade];
+    }
+
+    for (int grade = FIRST_GRADE; grade <= LAST_GRADE && !any_grade; ++grade) {
+        config->grades[grade] = 1;
+    }
+
+    return config->workload.clients_count > 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    // Запуск: ./HW2_Bench_IPC [grades=4,7,10] [single=N] [double=N] [jobs=N] [threads=N] [cas] [bin=DIR]
+    //         и параметры трассы из common/workload.h: [clients=N] [women=P] [rent=...] [rate=R] [burst=B] [seed=N]
+    bench_config_t config;
+    if (parse_config(&config, argc, argv) == -1 || write_trace(&config) == -1) {
+        return 1;
+    }
+
+    // Выводы программ читаются через канал, а завершившиеся клиенты не должны прерывать бенчмарк.
+    signal(SIGPIPE, SIG_IGN);
+    printf("%5s %8s %8s %12s %10s %10s %10s %10s\n", "grade", "booked", "rejected", "bookings/s", "p50, us",
+           "p99, us", "p999, us", "cpu, ms");
+
+    for (int grade = FIRST_GRADE; grade <= LAST_GRADE; ++grade) {
+        if (config.grades[grade]) {
+            bench_grade(&config, grade);
+        }
+    }
+
+    unlink(TRACE_NAME);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/cache_line.h"
+#include "../common/rooms_segment.h"
+
+#define MAX_THREADS 64
+
+// Плотная раскладка, как до выравнивания сегмента: блокировки шардов и счетчики писателей лежат вплотную,
+// и несколько потоков пишут в одну кеш-линию.
+typedef struct {
+    shm_lock_t locks[MAX_THREADS];
+    uint64_t counters[MAX_THREADS];
+} packed_data_t;
+
+// Параметры запуска и данные, с которыми работают потоки.
+typedef struct {
+    int threads_count;
+    int iterations_count;
+    // Блокировка и счетчик каждого потока.
+    shm_lock_t *locks[MAX_THREADS];
+    uint64_t *counters[MAX_THREADS];
+} bench_config_t;
+
+typedef struct {
+    const bench_config_t *config;
+    int thread_idx;
+} worker_args_t;
+
+// Каждый поток захватывает свою блокировку и увеличивает свой счетчик: потоки не делят ни одного поля, поэтому
+// вся разница между раскладками - в том, делят ли они кеш-линии.
+static void *run_worker(void *arg) {
+    const worker_args_t *args = arg;
+    shm_lock_t *lock = args->config->locks[args->thread_idx];
+    uint64_t *counter = args->config->counters[args->thread_idx];
+
+    for (int i = 0; i < args->config->iterations_count; ++i) {
+        shm_lock(lock);
+        stats_count(counter);
+        shm_unlock(lock);
+    }
+
+    return NULL;
+}
+
+// Открывает счетчик промахов кеша для текущего процесса и потоков, которые он создаст.
+// Возвращает -1, если аппаратные счетчики недоступны (например, в виртуальной машине).
+static int open_cache_misses_counter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Запускает потоки и печатает пропускную способность и число промахов кеша на операцию.
+static void run(const char *name, const bench_config_t *config) {
+    pthread_t threads[MAX_THREADS];
+    worker_args_t args[MAX_THREADS];
+    struct timespec started_at, finished_at;
+
+    int counter_fd = open_cache_misses_counter();
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    for (int i = 0; i < config->threads_count; ++i) {
+        args[i].config = config;
+        args[i].thread_idx = i;
+        pthread_create(&threads[i], NULL, run_worker, &args[i]);
+    }
+
+    for (int i = 0; i < config->threads_count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+    double seconds = (double) (finished_at.tv_sec - started_at.tv_sec) +
+                     (double) (finished_at.tv_nsec - started_at.tv_nsec) / 1e9;
+    double operations = (double) config->threads_count * config->iterations_count;
+
+    uint64_t cache_misses = 0;
+    if (counter_fd != -1 && read(counter_fd, &cache_misses, sizeof(cache_misses)) == sizeof(cache_misses)) {
+        printf("%8s %8d %14.0f %20.3f\n", name, config->threads_count, operations / seconds,
+               (double) cache_misses / operations);
+    } else {
+        printf("%8s %8d %14.0f %20s\n", name, config->threads_count, operations / seconds, "n/a");
+    }
+
+    if (counter_fd != -1) {
+        close(counter_fd);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // Запуск: ./HW2_Bench_Layout [threads=N] [iterations=N]
+    bench_config_t config;
+    config.threads_count = 4;
+    config.iterations_count = 2000000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "threads=", 8) == 0) {
+            config.threads_count = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "iterations=", 11) == 0) {
+            config.iterations_count = atoi(argv[i] + 11);
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (config.threads_count < 1 || config.threads_count > MAX_THREADS) {
+        fprintf(stderr, "threads must be from 1 to %d\n", MAX_THREADS);
+        return 1;
+    }
+
+    printf("%8s %8s %14s %20s\n", "layout", "threads", "ops/s", "cache misses/op");
+
+    // Прежняя раскладка: соседние потоки пишут в одни и те же кеш-линии.
+    packed_data_t *packed = aligned_alloc(CACHE_LINE_SIZE, cache_line_round(sizeof(packed_data_t)));
+    memset(packed, 0, sizeof(packed_data_t));
+    for (int i = 0; i < config.threads_count; ++i) {
+        shm_lock_init(&packed->locks[i]);
+        config.locks[i] = &packed->locks[i];
+        config.counters[i] = &packed->counters[i];
+    }
+
+    run("packed", &config);
+
+    // Сегмент отеля: у каждого потока свой шард с блокировкой на отдельной кеш-линии и своя полоса счетчиков.
+    rooms_config_t rooms_config = {.single_rooms_count = config.threads_count,
+                                   .double_rooms_count = config.threads_count, .booking_mode = booking_with_lock,
+                                   .shards_count = config.threads_count, .log_level = log_level_off};
+    size_t size = rooms_segment_size(&rooms_config);
+    rooms_header_t *segment = aligned_alloc(CACHE_LINE_SIZE, size);
+    rooms_segment_init(segment, &rooms_config);
+    for (int i = 0; i < config.threads_count; ++i) {
+        config.locks[i] = &rooms_segment_shard(segment, i)->lock;
+        config.counters[i] = &stats_stripe(&segment->stats, (uint32_t) i)->booked;
+    }
+
+    run("padded", &config);
+
+    free(packed);
+    free(segment);
+    return 0;
+}
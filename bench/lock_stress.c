@@ -0,0 +1,367 @@
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/cache_line.h"
+#include "../common/rooms_segment.h"
+#include "../common/sysv_lock.h"
+
+// Проверяемая блокировка.
+typedef enum {
+    // Набор семафоров System V из common/sysv_lock.h, по семафору на шард сегмента (программы на 6 и 8 баллов).
+    lock_sysv,
+    // Прежний протокол программ на 6 и 8 баллов.
+    lock_legacy,
+    // Неименованный семафор POSIX в shared memory.
+    lock_posix,
+    // Блокировки на futex из common/shm_lock.h в шардах сегмента (программы на 5 и 7 баллов, на 8 - с lock=futex).
+    lock_futex,
+    // Семафоры System V внутри самой программы на 6 баллов: нарушения ищутся по ее журналу.
+    lock_grade6
+} lock_kind;
+
+// Общая память стресс-теста: блокировка, счетчики, владельцы номеров и сегмент с состоянием комнат сразу за ними.
+typedef struct {
+    sem_t posix_lock;
+    uint64_t violations;
+    uint64_t bookings;
+    int32_t owners[];
+} stress_data_t;
+
+// Параметры запуска.
+typedef struct {
+    int processes_count;
+    int iterations_count;
+    int rooms_count;
+    int crashes_count;
+    int shards_count;
+    lock_kind lock;
+    // Каталог с программой на 6 баллов.
+    char bin_dir[512];
+} stress_config_t;
+
+int sem_id;
+
+// Прежний протокол программ на 6 и 8 баллов: ожидание нуля и установка единицы - две отдельные операции,
+// между которыми блокировку может захватить другой процесс.
+static void legacy_lock(int id) {
+    struct sembuf sem_op = {0, 0, 0};
+    semop(id, &sem_op, 1);
+    semctl(id, 0, SETVAL, 1);
+}
+
+static void legacy_unlock(int id) {
+    semctl(id, 0, SETVAL, 0);
+}
+
+static const char *lock_names[] = {"sysv", "legacy", "posix", "futex", "grade6"};
+
+static void stress_lock(const stress_config_t *config, stress_data_t *data) {
+    switch (config->lock) {
+        case lock_legacy:
+            legacy_lock(sem_id);
+            break;
+        case lock_posix:
+            sem_wait(&data->posix_lock);
+            break;
+        case lock_sysv:
+        case lock_futex:
+        case lock_grade6:
+            break;
+    }
+}
+
+static void stress_unlock(const stress_config_t *config, stress_data_t *data) {
+    switch (config->lock) {
+        case lock_legacy:
+            legacy_unlock(sem_id);
+            break;
+        case lock_posix:
+            sem_post(&data->posix_lock);
+            break;
+        case lock_sysv:
+        case lock_futex:
+        case lock_grade6:
+            break;
+    }
+}
+
+// Бронирует и освобождает номера, проверяя, что у каждого занятого номера ровно один владелец.
+// Блокировки на futex и семафоры System V защищают каждая свой шард и берутся внутри rooms_segment_book, остальные
+// блокировки защищают все шарды сразу.
+static void run_client(const stress_config_t *config, stress_data_t *data, rooms_header_t *rooms) {
+    int lock_shards = config->lock == lock_futex || config->lock == lock_sysv;
+    int32_t pid = getpid();
+    rooms_booking_t booking;
+
+    for (int i = 0; i < config->iterations_count; ++i) {
+        stress_lock(config, data);
+        int result = rooms_segment_book(rooms, pid + i, 0, lock_shards, &booking);
+        stress_unlock(config, data);
+
+        if (result == -1) {
+            sched_yield();
+            continue;
+        }
+
+        // Пока номер занят, никто другой не может его получить: второй владелец означает сломанную блокировку.
+        int room = rooms_booking_room(rooms, &booking);
+        if (__atomic_exchange_n(&data->owners[room], pid, __ATOMIC_RELAXED) != 0) {
+            __atomic_fetch_add(&data->violations, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_fetch_add(&data->bookings, 1, __ATOMIC_RELAXED);
+
+        // Даем другим процессам поработать, пока номер занят.
+        sched_yield();
+
+        if (__atomic_exchange_n(&data->owners[room], 0, __ATOMIC_RELAXED) != pid) {
+            __atomic_fetch_add(&data->violations, 1, __ATOMIC_RELAXED);
+        }
+
+        stress_lock(config, data);
+        rooms_segment_release(rooms, &booking, 0, lock_shards);
+        stress_unlock(config, data);
+    }
+}
+
+static int parse_config(stress_config_t *config, int argc, char *argv[]) {
+    config->processes_count = 64;
+    config->iterations_count = 2000;
+    config->rooms_count = 4;
+    config->crashes_count = 0;
+    config->shards_count = 1;
+    config->lock = lock_sysv;
+
+    // По-умолчанию программа на 6 баллов ищется рядом со стресс-тестом.
+    const char *slash = strrchr(argv[0], '/');
+    snprintf(config->bin_dir, sizeof(config->bin_dir), "%.*s", slash != NULL ? (int) (slash - argv[0]) : 1,
+             slash != NULL ? argv[0] : ".");
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "processes=", 10) == 0) {
+            config->processes_count = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "iterations=", 11) == 0) {
+            config->iterations_count = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "rooms=", 6) == 0) {
+            config->rooms_count = atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "crashes=", 8) == 0) {
+            config->crashes_count = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "shards=", 7) == 0) {
+            config->shards_count = atoi(argv[i] + 7);
+        } else if (strcmp(argv[i], "legacy") == 0) {
+            config->lock = lock_legacy;
+        } else if (strcmp(argv[i], "posix") == 0) {
+            config->lock = lock_posix;
+        } else if (strcmp(argv[i], "futex") == 0) {
+            config->lock = lock_futex;
+        } else if (strcmp(argv[i], "grade6") == 0) {
+            config->lock = lock_grade6;
+        } else if (strncmp(argv[i], "bin=", 4) == 0) {
+            snprintf(config->bin_dir, sizeof(config->bin_dir), "%s", argv[i] + 4);
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    // Программа на 6 баллов сама запускает процесс на каждого клиента и сама их завершает.
+    if (config->lock == lock_grade6) {
+        config->crashes_count = 0;
+    }
+
+    // Прежний протокол и семафор POSIX не переживают падение процесса с захваченной блокировкой: остальные ждали бы
+    // вечно.
+    if (config->lock == lock_legacy || config->lock == lock_posix) {
+        config->crashes_count = 0;
+    }
+
+    // Шарды есть только у блокировок на futex и семафоров System V (в том числе в программе на 6 баллов), остальные
+    // блокировки одни на весь сегмент.
+    if (config->lock == lock_legacy || config->lock == lock_posix) {
+        config->shards_count = 1;
+    }
+
+    return config->rooms_count > 0 && config->shards_count > 0 ? 0 : -1;
+}
+
+// Прогоняет через программу на 6 баллов трассу из iterations клиентов с нулевым сроком аренды и проверяет по ее
+// журналу, что номер не достался двоим сразу. Программа пишет строку о выезде под семафором шарда, а следующий клиент
+// получает номер только после освобождения семафора, поэтому выезд в журнале всегда идет раньше следующего заселения. Клиент без строки с результатом (например, завершившийся
+// из-за удаленного семафора) тоже считается нарушением. Возвращает код возврата стресс-теста.
+static int run_grade6(const stress_config_t *config) {
+    const char *trace_name = "/tmp/hw2_lock_stress_clients.txt";
+    int clients_count = config->iterations_count;
+    int rooms_count = config->rooms_count;
+
+    FILE *trace = fopen(trace_name, "w");
+    if (trace == NULL) {
+        perror(trace_name);
+        return 1;
+    }
+
+    for (int i = 1; i <= clients_count; ++i) {
+        fprintf(trace, "%d %d 0\n", i, i % 2);
+    }
+    fclose(trace);
+
+    // Одноместных и двухместных номеров поровну: в двухместные заселяются по двое клиентов одного пола.
+    char command[1024];
+    snprintf(command, sizeof(command), "%s/HW2_Grade6 %d %d shards=%d clients=%s", config->bin_dir, rooms_count,
+             rooms_count, config->shards_count, trace_name);
+
+    // Текущий жилец каждого номера: у одноместного - клиент, у двухместного - число жильцов и их пол.
+    int32_t *single_owners = calloc((size_t) rooms_count, sizeof(int32_t));
+    int32_t *double_guests = calloc((size_t) rooms_count, sizeof(int32_t));
+    int32_t *double_genders = calloc((size_t) rooms_count, sizeof(int32_t));
+    // Номер каждого клиента (одноместные - 1..rooms, двухместные - -1..-rooms) и получил ли он ответ.
+    int32_t *client_rooms = calloc((size_t) clients_count + 1, sizeof(int32_t));
+    char *client_answered = calloc((size_t) clients_count + 1, 1);
+    uint64_t bookings = 0, rejected = 0, violations = 0;
+
+    struct timespec started_at, finished_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    FILE *output = popen(command, "r");
+    char line[256];
+    int id, room, gender;
+
+    while (output != NULL && fgets(line, sizeof(line), output) != NULL) {
+        if (sscanf(line, "[CLIENT-%d]", &id) != 1 || id < 1 || id > clients_count) {
+            continue;
+        }
+
+        if (sscanf(line, "[CLIENT-%*d] rent single room: idx = %d.", &room) == 1 && room >= 0 &&
+            room < rooms_count) {
+            violations += single_owners[room] != 0;
+            single_owners[room] = id;
+            client_rooms[id] = room + 1;
+        } else if (sscanf(line, "[CLIENT-%*d] rent double room: idx = %d, gender = %d", &room, &gender) == 2 &&
+                   room >= 0 && room < rooms_count) {
+            violations += double_guests[room] == 2 || (double_guests[room] == 1 && double_genders[room] != gender);
+            double_guests[room]++;
+            double_genders[room] = gender;
+            client_rooms[id] = -room - 1;
+        } else if (strstr(line, "end of rent!") != NULL) {
+            if (client_rooms[id] > 0 && single_owners[client_rooms[id] - 1] == id) {
+                single_owners[client_rooms[id] - 1] = 0;
+            } else if (client_rooms[id] < 0 && double_guests[-client_rooms[id] - 1] > 0) {
+                double_guests[-client_rooms[id] - 1]--;
+            } else {
+                violations++;
+            }
+            client_rooms[id] = 0;
+            continue;
+        } else if (strstr(line, "out of service!") != NULL) {
+            rejected++;
+        } else {
+            continue;
+        }
+
+        bookings += client_rooms[id] != 0;
+        violations += client_answered[id];
+        client_answered[id] = 1;
+    }
+
+    int status = output != NULL ? pclose(output) : -1;
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+    double seconds = (double) (finished_at.tv_sec - started_at.tv_sec) +
+                     (double) (finished_at.tv_nsec - started_at.tv_nsec) / 1e9;
+
+    uint64_t lost = 0;
+    for (int i = 1; i <= clients_count; ++i) {
+        lost += !client_answered[i];
+    }
+
+    printf("%s lock: clients = %d, rooms = %d + %d, bookings = %llu, rejected = %llu, lost = %llu, "
+           "violations = %llu, %.0f bookings/s.\n", lock_names[config->lock], clients_count, rooms_count,
+           rooms_count, (unsigned long long) bookings, (unsigned long long) rejected, (unsigned long long) lost,
+           (unsigned long long) violations, (double) (bookings + rejected) / seconds);
+
+    free(single_owners);
+    free(double_guests);
+    free(double_genders);
+    free(client_rooms);
+    free(client_answered);
+    unlink(trace_name);
+    return status == -1 || lost != 0 || violations != 0 ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    // Запуск: ./HW2_Stress_Lock [processes=N] [iterations=N] [rooms=N] [crashes=N] [shards=N]
+    //         [legacy | posix | futex | grade6] [bin=DIR]
+    // crashes=N процессов завершаются, удерживая блокировку: остальные должны продолжить работу.
+    // shards=N делит номера между N шардами со своими блокировками (для sysv, futex и grade6).
+    // grade6 прогоняет iterations клиентов через саму программу на 6 баллов из каталога bin.
+    stress_config_t config;
+    if (parse_config(&config, argc, argv) == -1) {
+        return 1;
+    }
+
+    if (config.lock == lock_grade6) {
+        return run_grade6(&config);
+    }
+
+    rooms_config_t rooms_config = {.single_rooms_count = config.rooms_count, .booking_mode = booking_with_lock,
+                                   .shards_count = config.shards_count, .log_level = log_level_off};
+    size_t data_size = sizeof(stress_data_t) + sizeof(int32_t) * config.rooms_count;
+    data_size = cache_line_round(data_size);
+    size_t size = data_size + rooms_segment_size(&rooms_config);
+
+    stress_data_t *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    rooms_header_t *rooms = (rooms_header_t *) ((char *) data + data_size);
+    rooms_segment_init(rooms, &rooms_config);
+
+    sem_id = semget(IPC_PRIVATE, rooms->shards_count, IPC_CREAT | 0600);
+    if (config.lock == lock_legacy) {
+        semctl(sem_id, 0, SETVAL, 0);
+    } else if (config.lock == lock_sysv) {
+        rooms_segment_use_sysv_locks(rooms, sem_id);
+    }
+
+    sem_init(&data->posix_lock, 1, 1);
+
+    struct timespec started_at, finished_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    for (int i = 0; i < config.processes_count + config.crashes_count; ++i) {
+        if (fork() != 0) {
+            continue;
+        }
+
+        if (i >= config.processes_count) {
+            // Процесс падает посреди критической секции.
+            if (config.lock == lock_futex || config.lock == lock_sysv) {
+                rooms_shard_lock(rooms, i % rooms->shards_count);
+            } else {
+                stress_lock(&config, data);
+            }
+            _exit(1);
+        }
+
+        run_client(&config, data, rooms);
+        _exit(0);
+    }
+
+    while (wait(NULL) > 0) {
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+    double seconds = (double) (finished_at.tv_sec - started_at.tv_sec) +
+                     (double) (finished_at.tv_nsec - started_at.tv_nsec) / 1e9;
+
+    printf("%s lock: processes = %d, crashes = %d, shards = %d, bookings = %llu, violations = %llu, %.0f bookings/s.\n",
+           lock_names[config.lock], config.processes_count, config.crashes_count, rooms->shards_count,
+           (unsigned long long) data->bookings, (unsigned long long) data->violations, data->bookings / seconds);
+
+    int result = data->violations == 0 ? 0 : 1;
+    semctl(sem_id, 0, IPC_RMID, 0);
+    sem_destroy(&data->posix_lock);
+    munmap(data, size);
+    return result;
+}
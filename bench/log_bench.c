@@ -0,0 +1,139 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../common/event_log.h"
+#include "../common/stats.h"
+
+// Способ записи событий клиентов.
+typedef enum {
+    // printf в построчно буферизованный stdout, как раньше во всех программах.
+    log_with_printf,
+    // Кольцо журнала из common/event_log.h и фоновый писатель.
+    log_with_ring
+} log_mode;
+
+// Параметры запуска.
+typedef struct {
+    int processes_count;
+    int events_count;
+} bench_config_t;
+
+// Время записи событий одним клиентом. Клиенты пишут каждый в свою кеш-линию.
+typedef struct CACHE_LINE_ALIGNED {
+    stats_histogram_t write_time;
+} client_stats_t;
+
+// Читает и выбрасывает все, что приходит в канал, как терминал или файл, куда перенаправлен вывод отеля.
+static void *run_reader(void *arg) {
+    int fd = *(int *) arg;
+    char buffer[65536];
+
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+
+    return NULL;
+}
+
+// Пишет события одного клиента и замеряет, сколько длится каждая запись.
+static void run_client(log_mode mode, const bench_config_t *config, client_stats_t *stats, event_log_t *log, int idx) {
+    for (int i = 0; i < config->events_count; ++i) {
+        int client_id = idx * config->events_count + i;
+        uint64_t started_at = stats_now_ns();
+
+        if (mode == log_with_printf) {
+            printf("[CLIENT-%d] rent double room: idx = %d, gender = %d.\n", client_id, i, i & 1);
+        } else {
+            event_log_write(log, log_client_rent_double, client_id, i, i & 1);
+        }
+
+        stats_record(&stats->write_time, started_at);
+    }
+}
+
+// Запускает клиентов, выводящих события в канал, и печатает время одной записи.
+static void run(log_mode mode, const bench_config_t *config) {
+    // Счетчики клиентов и кольцо журнала лежат в общей памяти: сначала счетчики, за ними кольцо.
+    size_t stats_size = sizeof(client_stats_t) * config->processes_count;
+    size_t size = stats_size + event_log_size(EVENT_LOG_MAX_CAPACITY);
+    client_stats_t *stats = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    event_log_t *log = (event_log_t *) ((char *) stats + stats_size);
+    event_log_init(log, EVENT_LOG_MAX_CAPACITY, log_level_debug, 0);
+
+    // Весь вывод клиентов и писателя уходит в канал, который читает отдельный поток.
+    int pipe_fds[2];
+    pipe(pipe_fds);
+    pthread_t reader;
+    pthread_create(&reader, NULL, run_reader, &pipe_fds[0]);
+
+    event_log_writer_t writer;
+    event_log_writer_start(&writer, mode == log_with_ring ? log : NULL, pipe_fds[1]);
+
+    struct timespec started_at, finished_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    for (int i = 0; i < config->processes_count; ++i) {
+        if (fork() == 0) {
+            dup2(pipe_fds[1], STDOUT_FILENO);
+            setvbuf(stdout, NULL, _IOLBF, 0);
+            run_client(mode, config, &stats[i], log, i);
+            fflush(stdout);
+            _exit(0);
+        }
+    }
+
+    while (wait(NULL) > 0) {
+    }
+
+    // Время прогона включает вывод всех записей писателем.
+    event_log_writer_stop(&writer);
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+    close(pipe_fds[1]);
+    pthread_join(reader, NULL);
+    close(pipe_fds[0]);
+
+    double seconds = (double) (finished_at.tv_sec - started_at.tv_sec) +
+                     (double) (finished_at.tv_nsec - started_at.tv_nsec) / 1e9;
+    stats_histogram_t total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < config->processes_count; ++i) {
+        stats_add_histogram(&total, &stats[i].write_time);
+    }
+
+    printf("%8s %10d %12.0f %10.3f %10.1f %10.1f %10llu\n", mode == log_with_printf ? "printf" : "ring",
+           config->processes_count, (double) total.count / seconds,
+           (double) total.total_ns / (double) total.count / 1e3,
+           stats_percentile_us(&total, 0.99), (double) total.max_ns / 1e3,
+           (unsigned long long) log->dropped);
+
+    munmap(stats, size);
+}
+
+int main(int argc, char *argv[]) {
+    // Запуск: ./HW2_Bench_Log [processes=N] [events=N]
+    bench_config_t config;
+    config.processes_count = 16;
+    config.events_count = 2000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "processes=", 10) == 0) {
+            config.processes_count = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "events=", 7) == 0) {
+            config.events_count = atoi(argv[i] + 7);
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("%8s %10s %12s %10s %10s %10s %10s\n", "log", "processes", "events/s", "mean, us", "p99, us", "max, us",
+           "dropped");
+    run(log_with_printf, &config);
+    run(log_with_ring, &config);
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/rooms_segment.h"
+
+// Доля занятых номеров, которую поддерживает бенчмарк.
+#define OCCUPANCY_PERCENT 90
+#define OPERATIONS_COUNT 200000
+// Число отказов, которое замеряется в заполненном отеле: последовательный просмотр на каждый отказ слишком долгий.
+#define REJECTIONS_COUNT 2000
+
+// Бронирование, удерживаемое бенчмарком.
+typedef struct {
+    int is_double;
+    int idx;
+    int gender;
+} booking_t;
+
+// Бронирует номер последовательным просмотром массивов (алгоритм до введения битовых карт).
+static int linear_book(room_status *single_rooms, int single_count, room_status *double_rooms, int double_count,
+                       int gender, int *is_double) {
+    for (int i = 0; i < single_count; ++i) {
+        if (single_rooms[i] == freed) {
+            single_rooms[i] = full;
+            *is_double = 0;
+            return i;
+        }
+    }
+
+    for (int i = 0; i < double_count; ++i) {
+        if (double_rooms[i] == freed) {
+            double_rooms[i] = gender == 0 ? busied_by_man : busied_by_woman;
+            *is_double = 1;
+            return i;
+        } else if ((double_rooms[i] == busied_by_man && gender == 0) ||
+                   (double_rooms[i] == busied_by_woman && gender == 1)) {
+            double_rooms[i] = full;
+            *is_double = 1;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Освобождает номер, забронированный linear_book.
+static void linear_release(room_status *single_rooms, room_status *double_rooms, const booking_t *booking) {
+    if (!booking->is_double) {
+        single_rooms[booking->idx] = freed;
+    } else if (double_rooms[booking->idx] == full) {
+        double_rooms[booking->idx] = booking->gender == 0 ? busied_by_man : busied_by_woman;
+    } else {
+        double_rooms[booking->idx] = freed;
+    }
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Прогоняет одну и ту же последовательность бронирований и выездов для обоих алгоритмов
+// и возвращает среднее время операции в наносекундах.
+static double run(int rooms_count, int use_bitmap) {
+    int single_count = rooms_count / 2;
+    int double_count = rooms_count - single_count;
+    int capacity = single_count + double_count * 2;
+    int target = capacity / 100 * OCCUPANCY_PERCENT;
+
+    room_status *single_rooms = calloc(single_count, sizeof(room_status));
+    room_status *double_rooms = calloc(double_count, sizeof(room_status));
+    rooms_config_t config = {.single_rooms_count = single_count, .double_rooms_count = double_count,
+                             .booking_mode = booking_with_lock, .shards_count = 1, .log_level = log_level_off};
+    rooms_header_t *segment = aligned_alloc(CACHE_LINE_SIZE, rooms_segment_size(&config));
+    booking_t *bookings = malloc(sizeof(booking_t) * capacity);
+    int bookings_count = 0;
+
+    rooms_segment_init(segment, &config);
+    rooms_view_t view = rooms_segment_view(segment, 0);
+    srand(42);
+
+    double started_at = 0;
+
+    for (int op = 0; op < target + OPERATIONS_COUNT; ++op) {
+        if (op == target) {
+            started_at = now_seconds();
+        }
+
+        // После заполнения отеля чередуем выезд случайного гостя и заселение нового.
+        if (bookings_count >= target) {
+            int victim = rand() % bookings_count;
+            booking_t booking = bookings[victim];
+            bookings[victim] = bookings[--bookings_count];
+
+            if (!use_bitmap) {
+                linear_release(single_rooms, double_rooms, &booking);
+            } else if (booking.is_double) {
+                rooms_release_double(&view, booking.idx, booking.gender);
+            } else {
+                rooms_release_single(&view, booking.idx);
+            }
+        }
+
+        booking_t booking = {0, -1, rand() % 2};
+
+        if (!use_bitmap) {
+            booking.idx = linear_book(single_rooms, single_count, double_rooms, double_count, booking.gender,
+                                      &booking.is_double);
+        } else if ((booking.idx = rooms_book_single(&view)) == -1) {
+            room_status previous_status;
+            booking.is_double = 1;
+            booking.idx = rooms_book_double(&view, booking.gender, &previous_status);
+        }
+
+        if (booking.idx >= 0) {
+            bookings[bookings_count++] = booking;
+        }
+    }
+
+    double elapsed = now_seconds() - started_at;
+    free(single_rooms);
+    free(double_rooms);
+    free(segment);
+    free(bookings);
+    return elapsed / OPERATIONS_COUNT * 1e9;
+}
+
+// Заполняет отель целиком и возвращает среднее время отказа очередному клиенту в наносекундах: при
+// последовательном просмотре каждый отказ просматривает оба массива, а rooms_segment_book отвечает по счетчикам.
+static double run_rejections(int rooms_count, int use_counters) {
+    int single_count = rooms_count / 2;
+    int double_count = rooms_count - single_count;
+
+    room_status *single_rooms = calloc(single_count, sizeof(room_status));
+    room_status *double_rooms = calloc(double_count, sizeof(room_status));
+    rooms_config_t config = {.single_rooms_count = single_count, .double_rooms_count = double_count,
+                             .booking_mode = booking_with_lock, .shards_count = 1, .log_level = log_level_off};
+    rooms_header_t *segment = aligned_alloc(CACHE_LINE_SIZE, rooms_segment_size(&config));
+    rooms_booking_t booking;
+    int is_double;
+
+    rooms_segment_init(segment, &config);
+    for (int i = 0; i < single_count; ++i) {
+        single_rooms[i] = full;
+    }
+    for (int i = 0; i < double_count; ++i) {
+        double_rooms[i] = full;
+    }
+    while (rooms_segment_book(segment, 0, 0, 0, &booking) == 0) {
+    }
+
+    int rejections = 0;
+    double started_at = now_seconds();
+
+    for (int op = 0; op < REJECTIONS_COUNT; ++op) {
+        if (!use_counters) {
+            rejections += linear_book(single_rooms, single_count, double_rooms, double_count, op % 2, &is_double) == -1;
+        } else {
+            rejections += rooms_segment_book(segment, op, op % 2, 0, &booking) == -1;
+        }
+    }
+
+    double elapsed = now_seconds() - started_at;
+    free(single_rooms);
+    free(double_rooms);
+    free(segment);
+    return rejections == REJECTIONS_COUNT ? elapsed / REJECTIONS_COUNT * 1e9 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    int sizes[] = {1000, 10000, 100000};
+    int sizes_count = sizeof(sizes) / sizeof(sizes[0]);
+
+    // Размеры отеля можно передать аргументами: ./rooms_bench 10000 100000
+    if (argc > 1) {
+        sizes_count = argc - 1 > 3 ? 3 : argc - 1;
+        for (int i = 0; i < sizes_count; ++i) {
+            sizes[i] = atoi(argv[i + 1]);
+        }
+    }
+
+    printf("%10s %16s %16s\n", "rooms", "linear, ns/op", "bitmap, ns/op");
+
+    for (int i = 0; i < sizes_count; ++i) {
+        printf("%10d %16.1f %16.1f\n", sizes[i], run(sizes[i], 0), run(sizes[i], 1));
+    }
+
+    printf("\n%10s %16s %16s\n", "rooms", "linear reject", "counters reject");
+
+    for (int i = 0; i < sizes_count; ++i) {
+        printf("%10d %16.1f %16.1f\n", sizes[i], run_rejections(sizes[i], 0), run_rejections(sizes[i], 1));
+    }
+
+    return 0;
+}
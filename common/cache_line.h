@@ -0,0 +1,19 @@
+#ifndef HW2_COMMON_CACHE_LINE_H
+#define HW2_COMMON_CACHE_LINE_H
+
+#include <stdint.h>
+
+// Размер кеш-линии на x86-64 и большинстве ARM. Данные, которые меняют разные процессы, раскладываются по разным
+// линиям: иначе запись в одно поле отбирает у остальных ядер линию целиком, даже если они читают соседнее поле
+// (ложное разделение).
+#define CACHE_LINE_SIZE 64
+
+// Выравнивает тип или поле структуры по началу кеш-линии. Размер такой структуры тоже кратен кеш-линии.
+#define CACHE_LINE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+
+// Округляет размер или смещение вверх до целого числа кеш-линий.
+static inline uint64_t cache_line_round(uint64_t size) {
+    return (size + CACHE_LINE_SIZE - 1) & ~(uint64_t) (CACHE_LINE_SIZE - 1);
+}
+
+#endif //HW2_COMMON_CACHE_LINE_H
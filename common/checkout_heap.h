@@ -0,0 +1,88 @@
+#ifndef HW2_COMMON_CHECKOUT_HEAP_H
+#define HW2_COMMON_CHECKOUT_HEAP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Запланированный выезд гостя.
+typedef struct {
+    int64_t expires_at;
+    // Кого выселять: клиент в демоне на 9-10 баллов или запись ожидающего выезда в потоке выездов (common/hotel_checkouts.h).
+    int32_t id;
+} hotel_checkout_t;
+
+// Двоичная куча выездов, упорядоченная по времени окончания аренды.
+typedef struct {
+    hotel_checkout_t *items;
+    int capacity;
+    int count;
+} checkout_heap_t;
+
+// Выделяет кучу на capacity выездов, дальше она растет сама. Возвращает -1, если не хватило памяти.
+static inline int checkout_heap_init(checkout_heap_t *heap, int capacity) {
+    heap->capacity = capacity > 16 ? capacity : 16;
+    heap->count = 0;
+    heap->items = malloc(sizeof(hotel_checkout_t) * heap->capacity);
+    return heap->items != NULL ? 0 : -1;
+}
+
+// Освобождает память кучи.
+static inline void checkout_heap_free(checkout_heap_t *heap) {
+    free(heap->items);
+    heap->items = NULL;
+}
+
+// Добавляет выезд в кучу. Возвращает -1, если не хватило памяти.
+static inline int checkout_heap_push(checkout_heap_t *heap, int32_t id, int64_t expires_at) {
+    if (heap->count == heap->capacity) {
+        hotel_checkout_t *items = realloc(heap->items, sizeof(hotel_checkout_t) * heap->capacity * 2);
+        if (items == NULL) {
+            return -1;
+        }
+
+        heap->items = items;
+        heap->capacity *= 2;
+    }
+
+    int idx = heap->count++;
+    hotel_checkout_t checkout = {expires_at, id};
+
+    // Поднимаем новый элемент, пока он раньше родителя.
+    while (idx > 0 && heap->items[(idx - 1) / 2].expires_at > expires_at) {
+        heap->items[idx] = heap->items[(idx - 1) / 2];
+        idx = (idx - 1) / 2;
+    }
+
+    heap->items[idx] = checkout;
+    return 0;
+}
+
+// Удаляет из кучи самый ранний выезд.
+static inline void checkout_heap_pop(checkout_heap_t *heap) {
+    hotel_checkout_t last = heap->items[--heap->count];
+    int idx = 0;
+
+    // Опускаем последний элемент на место корня, пока у него есть более ранний потомок.
+    while (idx * 2 + 1 < heap->count) {
+        int child = idx * 2 + 1;
+        if (child + 1 < heap->count && heap->items[child + 1].expires_at < heap->items[child].expires_at) {
+            child++;
+        }
+
+        if (heap->items[child].expires_at >= last.expires_at) {
+            break;
+        }
+
+        heap->items[idx] = heap->items[child];
+        idx = child;
+    }
+
+    heap->items[idx] = last;
+}
+
+// Возвращает момент ближайшего выезда или -1, если выездов не запланировано.
+static inline int64_t checkout_heap_next(const checkout_heap_t *heap) {
+    return heap->count > 0 ? heap->items[0].expires_at : -1;
+}
+
+#endif //HW2_COMMON_CHECKOUT_HEAP_H
@@ -0,0 +1,68 @@
+#ifndef HW2_COMMON_CLIENT_RING_H
+#define HW2_COMMON_CLIENT_RING_H
+
+#include <sched.h>
+#include <stdint.h>
+
+#include "cache_line.h"
+#include "clients.h"
+
+#define CLIENT_RING_SIZE 64
+
+// Ячейка кольцевого буфера. Номер sequence показывает, чья очередь работать с ячейкой:
+// равен позиции записи, если ячейка свободна для записи, и позиции + 1, если запись можно забрать.
+// Каждая ячейка занимает свою кеш-линию: соседние ячейки одновременно забирают разные процессы.
+typedef struct CACHE_LINE_ALIGNED {
+    uint64_t sequence;
+    client_record_t record;
+} client_ring_slot_t;
+
+// Ограниченный кольцевой буфер записей клиентов в shared memory: пишет один процесс (отель), забирают многие.
+// Блокировкой на пустом или полном буфере занимаются семафоры свободных и занятых ячеек,
+// поэтому здесь только раздаются позиции и упорядочивается доступ к ячейкам.
+// Позицию чтения меняют все читатели, а позицию записи - только отель, поэтому они лежат на разных кеш-линиях.
+typedef struct {
+    CACHE_LINE_ALIGNED uint64_t head;
+    CACHE_LINE_ALIGNED uint64_t tail;
+    client_ring_slot_t slots[CLIENT_RING_SIZE];
+} client_ring_t;
+
+// Помечает все ячейки буфера свободными.
+static inline void client_ring_init(client_ring_t *ring) {
+    ring->head = 0;
+    ring->tail = 0;
+
+    for (int i = 0; i < CLIENT_RING_SIZE; ++i) {
+        ring->slots[i].sequence = (uint64_t) i;
+    }
+}
+
+// Кладет запись в буфер. Вызывается единственным писателем после захвата семафора свободных ячеек.
+static inline void client_ring_push(client_ring_t *ring, const client_record_t *record) {
+    uint64_t position = ring->tail++;
+    client_ring_slot_t *slot = &ring->slots[position % CLIENT_RING_SIZE];
+
+    // Семафор гарантирует лишь, что какая-то ячейка свободна: читатель этой ячейки мог еще не закончить,
+    // если читатели следующих ячеек обогнали его.
+    while (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != position) {
+        sched_yield();
+    }
+
+    slot->record = *record;
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+// Забирает запись из буфера. Вызывается читателем после захвата семафора занятых ячеек.
+static inline void client_ring_pop(client_ring_t *ring, client_record_t *record) {
+    uint64_t position = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    client_ring_slot_t *slot = &ring->slots[position % CLIENT_RING_SIZE];
+
+    while (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != position + 1) {
+        sched_yield();
+    }
+
+    *record = slot->record;
+    __atomic_store_n(&slot->sequence, position + CLIENT_RING_SIZE, __ATOMIC_RELEASE);
+}
+
+#endif //HW2_COMMON_CLIENT_RING_H
@@ -0,0 +1,349 @@
+#ifndef HW2_COMMON_CLIENTS_H
+#define HW2_COMMON_CLIENTS_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CLIENTS_TRACE_MAGIC 0x43525448u
+#define CLIENTS_TRACE_VERSION 2
+// Флаг заголовка: за сроками аренды лежат моменты прибытия клиентов.
+#define CLIENTS_TRACE_ARRIVALS 1
+
+// Запись о клиенте из файла clients.txt.
+typedef struct {
+    int32_t id;
+    int32_t gender;
+    int32_t rent_time;
+} client_record_t;
+
+// Заголовок двоичной трассы. Записи хранятся по столбцам: за заголовком лежат count идентификаторов int32_t,
+// затем биты полов (бит i - пол клиента i), а после выравнивания на 4 байта - сроки аренды шириной
+// rent_time_width байт (1 и 2 - без знака, 4 - int32_t). С флагом CLIENTS_TRACE_ARRIVALS после выравнивания
+// на 4 байта следуют моменты прибытия uint32_t в миллисекундах от начала трассы.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t rent_time_width;
+    uint8_t flags;
+    uint64_t count;
+} clients_trace_header_t;
+
+// Загруженная трасса клиентов. Столбцы двоичной трассы читаются прямо из отображенного файла,
+// столбцы текстовой трассы разбираются в отдельные массивы.
+typedef struct {
+    const int32_t *ids;
+    const uint8_t *genders;
+    const void *rent_times;
+    int rent_time_width;
+    // Моменты прибытия или NULL, если трасса их не содержит (тогда все клиенты приходят сразу).
+    const uint32_t *arrivals;
+    int count;
+    void *mapping;
+    size_t mapping_size;
+    int owns_columns;
+} clients_trace_t;
+
+// Возвращает размер столбца полов для count клиентов.
+static inline size_t clients_genders_size(size_t count) {
+    return (count + 7) / 8;
+}
+
+// Возвращает смещение столбца сроков аренды от начала двоичной трассы.
+static inline size_t clients_rent_times_offset(size_t count) {
+    size_t offset = sizeof(clients_trace_header_t) + sizeof(int32_t) * count + clients_genders_size(count);
+    return (offset + 3) & ~(size_t) 3;
+}
+
+// Возвращает смещение столбца моментов прибытия от начала двоичной трассы.
+static inline size_t clients_arrivals_offset(size_t count, int rent_time_width) {
+    size_t offset = clients_rent_times_offset(count) + (size_t) rent_time_width * count;
+    return (offset + 3) & ~(size_t) 3;
+}
+
+// Возвращает размер двоичной трассы из count клиентов со сроками аренды шириной rent_time_width байт.
+static inline size_t clients_binary_size(size_t count, int rent_time_width, int flags) {
+    if (flags & CLIENTS_TRACE_ARRIVALS) {
+        return clients_arrivals_offset(count, rent_time_width) + sizeof(uint32_t) * count;
+    }
+
+    return clients_rent_times_offset(count) + (size_t) rent_time_width * count;
+}
+
+// Возвращает срок аренды клиента idx.
+static inline int32_t clients_rent_time(const clients_trace_t *trace, int idx) {
+    if (trace->rent_time_width == 1) {
+        return ((const uint8_t *) trace->rent_times)[idx];
+    } else if (trace->rent_time_width == 2) {
+        return ((const uint16_t *) trace->rent_times)[idx];
+    }
+
+    return ((const int32_t *) trace->rent_times)[idx];
+}
+
+// Возвращает момент прибытия клиента idx в миллисекундах от начала трассы.
+static inline uint32_t clients_arrival(const clients_trace_t *trace, int idx) {
+    return trace->arrivals != NULL ? trace->arrivals[idx] : 0;
+}
+
+// Собирает запись о клиенте idx из столбцов трассы.
+static inline void clients_get(const clients_trace_t *trace, int idx, client_record_t *record) {
+    record->id = trace->ids[idx];
+    record->gender = (trace->genders[idx / 8] >> (idx % 8)) & 1;
+    record->rent_time = clients_rent_time(trace, idx);
+}
+
+// Возвращает наименьшую ширину столбца сроков аренды, в которую помещаются все сроки трассы.
+static inline int clients_min_rent_time_width(const clients_trace_t *trace) {
+    int width = 1;
+
+    for (int i = 0; i < trace->count; ++i) {
+        int32_t rent_time = clients_rent_time(trace, i);
+
+        if (rent_time < 0 || rent_time > UINT16_MAX) {
+            return 4;
+        } else if (rent_time > UINT8_MAX) {
+            width = 2;
+        }
+    }
+
+    return width;
+}
+
+// Читает десятичное число со знаком, пропуская пробельные символы перед ним.
+// Возвращает позицию после числа или NULL, если числа нет.
+static inline const char *clients_scan_int(const char *position, const char *end, int32_t *value) {
+    // Пробелы, табуляции и переводы строк - все управляющие символы и пробел имеют коды не больше ' '.
+    while (position < end && (unsigned char) *position <= ' ') {
+        position++;
+    }
+
+    int negative = position < end && *position == '-';
+    position += negative;
+
+    const char *digits = position;
+    int32_t result = 0;
+
+    while (position < end && (unsigned) (*position - '0') < 10) {
+        result = result * 10 + (*position - '0');
+        position++;
+    }
+
+    if (position == digits) {
+        return NULL;
+    }
+
+    *value = negative ? -result : result;
+    return position;
+}
+
+// Выделяет столбцы текстовой трассы на capacity клиентов, сохраняя уже разобранных. Возвращает -1, если не хватило памяти.
+static inline int clients_reserve(clients_trace_t *trace, size_t capacity) {
+    size_t genders_size = trace->count > 0 ? clients_genders_size((size_t) trace->count) : 0;
+    int32_t *ids = realloc((void *) trace->ids, sizeof(int32_t) * capacity);
+    trace->ids = ids != NULL ? ids : trace->ids;
+    uint8_t *genders = realloc((void *) trace->genders, clients_genders_size(capacity));
+    trace->genders = genders != NULL ? genders : trace->genders;
+    int32_t *rent_times = realloc((void *) trace->rent_times, sizeof(int32_t) * capacity);
+    trace->rent_times = rent_times != NULL ? rent_times : trace->rent_times;
+
+    if (ids == NULL || genders == NULL || rent_times == NULL) {
+        return -1;
+    }
+
+    memset(genders + genders_size, 0, clients_genders_size(capacity) - genders_size);
+    return 0;
+}
+
+// Выделяет столбец моментов прибытия на capacity клиентов. Возвращает -1, если не хватило памяти.
+static inline int clients_reserve_arrivals(clients_trace_t *trace, size_t capacity) {
+    uint32_t *arrivals = realloc((void *) trace->arrivals, sizeof(uint32_t) * capacity);
+
+    if (arrivals == NULL) {
+        return -1;
+    }
+
+    trace->arrivals = arrivals;
+    return 0;
+}
+
+// Разбирает текстовую трассу со строками "id gender rent_time".
+// Место под записи выделяется заранее по числу строк, которые считаются через memchr (в libc он использует SIMD).
+static inline int clients_parse_text(clients_trace_t *trace, const char *text, size_t size) {
+    const char *end = text + size;
+    size_t capacity = 1;
+
+    for (const char *line = text; (line = memchr(line, '\n', (size_t) (end - line))) != NULL; ++line) {
+        capacity++;
+    }
+
+    trace->owns_columns = 1;
+    trace->rent_time_width = sizeof(int32_t);
+    if (clients_reserve(trace, capacity) == -1) {
+        return -1;
+    }
+
+    const char *position = text;
+    client_record_t record;
+
+    while ((position = clients_scan_int(position, end, &record.id)) != NULL &&
+           (position = clients_scan_int(position, end, &record.gender)) != NULL &&
+           (position = clients_scan_int(position, end, &record.rent_time)) != NULL) {
+        // Несколько записей в одной строке не запрещены, поэтому столбцы может понадобиться расширить.
+        if ((size_t) trace->count == capacity) {
+            if (clients_reserve(trace, capacity * 2) == -1) {
+                return -1;
+            }
+
+            capacity *= 2;
+        }
+
+        // Пол хранится одним битом, поэтому любое ненулевое значение считается полом 1.
+        int idx = trace->count++;
+        ((int32_t *) trace->ids)[idx] = record.id;
+        ((uint8_t *) trace->genders)[idx / 8] |= (uint8_t) ((record.gender != 0) << (idx % 8));
+        ((int32_t *) trace->rent_times)[idx] = record.rent_time;
+    }
+
+    return 0;
+}
+
+// Подключает столбцы двоичной трассы, отображенной в память. Возвращает -1, если заголовок испорчен.
+static inline int clients_attach_binary(clients_trace_t *trace) {
+    const clients_trace_header_t *header = trace->mapping;
+    const char *base = trace->mapping;
+    int width = header->rent_time_width;
+
+    if (header->version != CLIENTS_TRACE_VERSION || (width != 1 && width != 2 && width != 4) ||
+        header->count > INT32_MAX ||
+        clients_binary_size(header->count, width, header->flags) > trace->mapping_size) {
+        return -1;
+    }
+
+    trace->count = (int) header->count;
+    trace->rent_time_width = width;
+    trace->ids = (const int32_t *) (header + 1);
+    trace->genders = (const uint8_t *) (trace->ids + trace->count);
+    trace->rent_times = base + clients_rent_times_offset(header->count);
+    if (header->flags & CLIENTS_TRACE_ARRIVALS) {
+        trace->arrivals = (const uint32_t *) (base + clients_arrivals_offset(header->count, width));
+    }
+    return 0;
+}
+
+// Загружает трассу клиентов из файла, отображая его в память. Формат (текстовый или двоичный)
+// определяется по заголовку. Возвращает -1, если файл прочитать не удалось.
+static inline int clients_load(clients_trace_t *trace, const char *path) {
+    struct stat file_stat;
+    int fd = open(path, O_RDONLY);
+
+    memset(trace, 0, sizeof(clients_trace_t));
+    if (fd == -1 || fstat(fd, &file_stat) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    if (file_stat.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    trace->mapping_size = (size_t) file_stat.st_size;
+    trace->mapping = mmap(NULL, trace->mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (trace->mapping == MAP_FAILED) {
+        trace->mapping = NULL;
+        return -1;
+    }
+
+    madvise(trace->mapping, trace->mapping_size, MADV_SEQUENTIAL);
+    const clients_trace_header_t *header = trace->mapping;
+
+    if (trace->mapping_size >= sizeof(clients_trace_header_t) && header->magic == CLIENTS_TRACE_MAGIC) {
+        return clients_attach_binary(trace);
+    }
+
+    // После разбора текст больше не нужен.
+    int result = clients_parse_text(trace, trace->mapping, trace->mapping_size);
+    munmap(trace->mapping, trace->mapping_size);
+    trace->mapping = NULL;
+    return result;
+}
+
+// Сохраняет трассу в двоичном формате со сроками аренды шириной rent_time_width байт. Моменты прибытия
+// сохраняются, если они есть. Файл заполняется через отображение в память. Возвращает -1 при ошибке.
+static inline int clients_save_binary(const clients_trace_t *trace, const char *path, int rent_time_width) {
+    int flags = trace->arrivals != NULL ? CLIENTS_TRACE_ARRIVALS : 0;
+    size_t size = clients_binary_size((size_t) trace->count, rent_time_width, flags);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+    if (fd == -1 || ftruncate(fd, (off_t) size) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    clients_trace_header_t header = {CLIENTS_TRACE_MAGIC, CLIENTS_TRACE_VERSION, (uint8_t) rent_time_width,
+                                     (uint8_t) flags, (uint64_t) trace->count};
+    size_t genders_offset = sizeof(clients_trace_header_t) + sizeof(int32_t) * (size_t) trace->count;
+    char *rent_times = base + clients_rent_times_offset((size_t) trace->count);
+
+    memcpy(base, &header, sizeof(header));
+    memcpy(base + sizeof(header), trace->ids, sizeof(int32_t) * (size_t) trace->count);
+    memcpy(base + genders_offset, trace->genders, clients_genders_size((size_t) trace->count));
+
+    for (int i = 0; i < trace->count; ++i) {
+        int32_t rent_time = clients_rent_time(trace, i);
+
+        if (rent_time_width == 1) {
+            ((uint8_t *) rent_times)[i] = (uint8_t) rent_time;
+        } else if (rent_time_width == 2) {
+            ((uint16_t *) rent_times)[i] = (uint16_t) rent_time;
+        } else {
+            ((int32_t *) rent_times)[i] = rent_time;
+        }
+    }
+
+    if (flags & CLIENTS_TRACE_ARRIVALS) {
+        memcpy(base + clients_arrivals_offset((size_t) trace->count, rent_time_width), trace->arrivals,
+               sizeof(uint32_t) * (size_t) trace->count);
+    }
+
+    munmap(base, size);
+    return 0;
+}
+
+// Освобождает память трассы.
+static inline void clients_free(clients_trace_t *trace) {
+    if (trace->owns_columns) {
+        free((void *) trace->ids);
+        free((void *) trace->genders);
+        free((void *) trace->rent_times);
+        free((void *) trace->arrivals);
+    }
+
+    if (trace->mapping != NULL) {
+        munmap(trace->mapping, trace->mapping_size);
+    }
+
+    memset(trace, 0, sizeof(clients_trace_t));
+}
+
+#endif //HW2_COMMON_CLIENTS_H
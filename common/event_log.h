@@ -0,0 +1,387 @@
+#ifndef HW2_COMMON_EVENT_LOG_H
+#define HW2_COMMON_EVENT_LOG_H
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "cache_line.h"
+#include "stats.h"
+
+// Наименьшее и наибольшее число записей в кольце журнала. Число записей всегда степень двойки.
+#define EVENT_LOG_MIN_CAPACITY 64
+#define EVENT_LOG_MAX_CAPACITY 65536
+// Число записей в кольце, если отель не знает, сколько будет клиентов. Писатель просыпается на первую же запись,
+// а клиенты, которых запускают отдельно от отеля, столько событий, пока он выводит кольцо, не пишут.
+#define EVENT_LOG_DEFAULT_CAPACITY 1024
+// Сколько записей приходится на одного клиента с уровнем debug: запуск, лист ожидания, заселение, срок и выезд.
+#define EVENT_LOG_CLIENT_EVENTS 5
+// Размер буфера, в который писатель форматирует строки перед одним вызовом write.
+#define EVENT_LOG_BUFFER_SIZE 65536
+
+// Уровень журнала: записываются события с уровнем не выше заданного.
+typedef enum {
+    // Журнал выключен, события не записываются совсем.
+    log_level_off,
+    // Бронирования, отказы, ожидание в листе и выезды.
+    log_level_info,
+    // Все события, включая запуск клиента и срок аренды.
+    log_level_debug
+} log_level;
+
+// Событие клиента отеля. Каждому событию соответствует строка прежнего текстового журнала.
+typedef enum {
+    log_client_started,
+    log_client_waiting_room,
+    log_client_out_of_service,
+    // Аргументы: номер комнаты.
+    log_client_rent_single,
+    // Аргументы: номер комнаты, пол клиента.
+    log_client_rent_double,
+    // Аргументы: номер комнаты, пол клиента и соседа.
+    log_client_rent_double_shared,
+    // Аргументы: срок аренды в секундах.
+    log_client_waiting_rent,
+    log_client_end_of_rent
+} log_event;
+
+// Запись журнала фиксированного размера. Клиент заполняет ее несколькими числами, а текст строит писатель.
+typedef struct {
+    // Номер записи в кольце, по которому производитель и писатель узнают, кто из них владеет ячейкой.
+    uint64_t sequence;
+    uint64_t time_ns;
+    uint32_t event;
+    int32_t client_id;
+    int32_t args[2];
+} log_record_t;
+
+// Кольцо журнала в shared memory: много клиентов пишут, один писатель в отеле читает.
+// Клиент занимает ячейку, сдвигая tail атомарным compare-and-swap, заполняет ее и публикует, записав номер
+// следующего круга в sequence. Блокировок у клиента нет: если кольцо заполнено, запись отбрасывается и учитывается
+// в dropped, и бронирование не ждет вывода. Системный вызов клиент делает, только если будит уснувшего писателя.
+typedef struct CACHE_LINE_ALIGNED {
+    uint32_t level;
+    uint32_t capacity;
+    // Печатать ли перед строкой момент, когда клиент записал событие.
+    uint32_t with_time;
+    // Позиция, с которой читает писатель. Меняет ее только писатель, поэтому она на отдельной кеш-линии.
+    CACHE_LINE_ALIGNED uint64_t head;
+    // Байты, которые писатель не смог вывести.
+    uint64_t dropped_bytes;
+    // Следующая свободная позиция и число отброшенных записей меняют клиенты.
+    CACHE_LINE_ALIGNED uint64_t tail;
+    uint64_t dropped;
+    // Слово futex, которое клиенты увеличивают после каждой записи, и признак того, что писатель спит на нем.
+    uint32_t written;
+    uint32_t writer_sleeping;
+    CACHE_LINE_ALIGNED log_record_t records[];
+} event_log_t;
+
+// Возвращает число записей кольца, в которое поместятся records записей: степень двойки не меньше records в пределах
+// от EVENT_LOG_MIN_CAPACITY до EVENT_LOG_MAX_CAPACITY.
+static inline uint32_t event_log_capacity(uint64_t records) {
+    uint32_t capacity = EVENT_LOG_MIN_CAPACITY;
+
+    while (capacity < records && capacity < EVENT_LOG_MAX_CAPACITY) {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+// Возвращает размер кольца журнала на capacity записей.
+static inline uint64_t event_log_size(uint32_t capacity) {
+    return cache_line_round(sizeof(event_log_t) + sizeof(log_record_t) * capacity);
+}
+
+// Готовит пустое кольцо. Вызывается создателем сегмента до того, как им начнут пользоваться другие процессы.
+// Если with_time не ноль, писатель начинает каждую строку с момента события по монотонным часам.
+static inline void event_log_init(event_log_t *log, uint32_t capacity, log_level level, int with_time) {
+    log->level = level;
+    log->capacity = capacity;
+    log->with_time = with_time != 0;
+    log->head = 0;
+    log->dropped_bytes = 0;
+    log->tail = 0;
+    log->dropped = 0;
+    log->written = 0;
+    log->writer_sleeping = 0;
+
+    for (uint32_t i = 0; i < capacity; ++i) {
+        log->records[i].sequence = i;
+    }
+}
+
+// Возвращает уровень, начиная с которого записывается событие.
+static inline log_level event_log_event_level(log_event event) {
+    return event == log_client_started || event == log_client_waiting_rent ? log_level_debug : log_level_info;
+}
+
+// Записывает событие в кольцо, не дожидаясь места и писателя. Если журнал выключен или уровень события выше
+// заданного, ничего не делает.
+static inline void event_log_write(event_log_t *log, log_event event, int client_id, int arg0, int arg1) {
+    if (log == NULL || log->level < event_log_event_level(event)) {
+        return;
+    }
+
+    uint64_t position = __atomic_load_n(&log->tail, __ATOMIC_RELAXED);
+    log_record_t *record;
+
+    while (1) {
+        record = &log->records[position & (log->capacity - 1)];
+        uint64_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence == position) {
+            if (__atomic_compare_exchange_n(&log->tail, &position, position + 1, 1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (sequence < position) {
+            // Писатель еще не прочитал запись прошлого круга: кольцо заполнено.
+            __atomic_fetch_add(&log->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            position = __atomic_load_n(&log->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    record->time_ns = stats_now_ns();
+    record->event = event;
+    record->client_id = client_id;
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    __atomic_store_n(&record->sequence, position + 1, __ATOMIC_RELEASE);
+
+    // Будит писателя, если он уснул на пустом кольце. Будит его только один клиент, снявший признак.
+    __atomic_fetch_add(&log->written, 1, __ATOMIC_SEQ_CST);
+    uint32_t sleeping = 1;
+    if (__atomic_load_n(&log->writer_sleeping, __ATOMIC_SEQ_CST) &&
+        __atomic_compare_exchange_n(&log->writer_sleeping, &sleeping, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        syscall(SYS_futex, &log->written, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+// Создает кольцо журнала на capacity записей в памяти процесса, а не в shared memory: для отеля, клиенты которого
+// передают ему события сами. Возвращает NULL, если журнал выключен или не хватило памяти.
+static inline event_log_t *event_log_create(uint32_t capacity, log_level level, int with_time) {
+    if (level == log_level_off) {
+        return NULL;
+    }
+
+    event_log_t *log = aligned_alloc(CACHE_LINE_SIZE, event_log_size(capacity));
+    if (log != NULL) {
+        event_log_init(log, capacity, level, with_time);
+    }
+
+    return log;
+}
+
+// Забирает из кольца очередную опубликованную запись. Возвращает 0 или -1, если записей нет.
+// Вызывается только писателем журнала.
+static inline int event_log_read(event_log_t *log, log_record_t *record) {
+    log_record_t *slot = &log->records[log->head & (log->capacity - 1)];
+
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != log->head + 1) {
+        return -1;
+    }
+
+    *record = *slot;
+    // Ячейка освобождается для следующего круга.
+    __atomic_store_n(&slot->sequence, log->head + log->capacity, __ATOMIC_RELEASE);
+    log->head++;
+    return 0;
+}
+
+// Проверяет, есть ли в кольце опубликованная запись, не забирая ее. Вызывается только писателем журнала.
+static inline int event_log_empty(event_log_t *log) {
+    log_record_t *slot = &log->records[log->head & (log->capacity - 1)];
+    return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != log->head + 1;
+}
+
+// Выводит length байт из buffer в fd целиком, повторяя write после частичной записи и прерывания сигналом.
+// Байты, которые вывести не удалось, учитываются в dropped_bytes.
+static inline void event_log_write_all(event_log_t *log, int fd, const char *buffer, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, buffer, length);
+
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (written <= 0) {
+            __atomic_fetch_add(&log->dropped_bytes, length, __ATOMIC_RELAXED);
+            return;
+        }
+
+        buffer += written;
+        length -= written;
+    }
+}
+
+// Форматирует запись строкой прежнего текстового журнала. Возвращает длину строки, как snprintf.
+static inline int event_log_format(char *buffer, size_t size, const log_record_t *record) {
+    int id = record->client_id;
+
+    switch ((log_event) record->event) {
+        case log_client_started:
+            return snprintf(buffer, size, "[CLIENT-%d] started.\n", id);
+        case log_client_waiting_room:
+            return snprintf(buffer, size, "[CLIENT-%d] waiting for a room.\n", id);
+        case log_client_out_of_service:
+            return snprintf(buffer, size, "[CLIENT-%d] out of service!\n", id);
+        case log_client_rent_single:
+            return snprintf(buffer, size, "[CLIENT-%d] rent single room: idx = %i.\n", id, record->args[0]);
+        case log_client_rent_double:
+            return snprintf(buffer, size, "[CLIENT-%d] rent double room: idx = %d, gender = %d.\n", id,
+                            record->args[0], record->args[1]);
+        case log_client_rent_double_shared:
+            return snprintf(buffer, size, "[CLIENT-%d] rent double room: idx = %d, gender = %d, with_gender = %d.\n",
+                            id, record->args[0], record->args[1], record->args[1]);
+        case log_client_waiting_rent:
+            return snprintf(buffer, size, "[CLIENT-%d] waiting %ds.\n", id, record->args[0]);
+        case log_client_end_of_rent:
+            return snprintf(buffer, size, "[CLIENT-%d] end of rent!\n", id);
+    }
+
+    return snprintf(buffer, size, "[CLIENT-%d] unknown event %u.\n", id, record->event);
+}
+
+// Выводит все накопившиеся записи в файловый дескриптор fd. Строки собираются в буфер и выводятся большими
+// блоками через write, а не stdio: поток stdout с его блокировкой остается основному потоку и дочерним процессам.
+// Если журнал ведется со временем, строка начинается с момента события: "[секунды.наносекунды] [CLIENT-1] ...".
+// Возвращает число выведенных записей.
+static inline int event_log_drain(event_log_t *log, int fd) {
+    char buffer[EVENT_LOG_BUFFER_SIZE];
+    size_t length = 0;
+    int count = 0;
+    log_record_t record;
+
+    while (event_log_read(log, &record) == 0) {
+        char line[160];
+        int line_length = 0;
+
+        if (log->with_time) {
+            line_length = snprintf(line, sizeof(line), "[%llu.%09llu] ",
+                                   (unsigned long long) (record.time_ns / 1000000000),
+                                   (unsigned long long) (record.time_ns % 1000000000));
+        }
+
+        line_length += event_log_format(line + line_length, sizeof(line) - line_length, &record);
+        line_length = line_length < (int) sizeof(line) ? line_length : (int) sizeof(line) - 1;
+
+        if (length + line_length > sizeof(buffer)) {
+            event_log_write_all(log, fd, buffer, length);
+            length = 0;
+        }
+
+        memcpy(buffer + length, line, line_length);
+        length += line_length;
+        count++;
+    }
+
+    if (length > 0) {
+        event_log_write_all(log, fd, buffer, length);
+    }
+
+    return count;
+}
+
+// Фоновый писатель журнала в процессе отеля.
+typedef struct {
+    pthread_t thread;
+    event_log_t *log;
+    int fd;
+    int stopping;
+} event_log_writer_t;
+
+// Выводит записи журнала, пока писателя не остановят, и засыпает на futex, когда кольцо пусто.
+static inline void *event_log_writer_run(void *arg) {
+    event_log_writer_t *writer = arg;
+    event_log_t *log = writer->log;
+
+    while (1) {
+        if (event_log_drain(log, writer->fd) > 0) {
+            continue;
+        }
+
+        // Признак сна выставляется до чтения слова futex и проверки кольца: клиент, опубликовавший запись после
+        // проверки, либо увидит признак и разбудит писателя, либо успеет изменить слово, и futex не уснет.
+        // Остановка тоже меняет слово, поэтому флаг остановки читается после него.
+        __atomic_store_n(&log->writer_sleeping, 1, __ATOMIC_SEQ_CST);
+        uint32_t written = __atomic_load_n(&log->written, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&writer->stopping, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        if (event_log_empty(log)) {
+            syscall(SYS_futex, &log->written, FUTEX_WAIT, written, NULL, NULL, 0);
+        }
+
+        __atomic_store_n(&log->writer_sleeping, 0, __ATOMIC_RELAXED);
+    }
+
+    // Выводим то, что клиенты успели записать до остановки.
+    __atomic_store_n(&log->writer_sleeping, 0, __ATOMIC_RELAXED);
+    event_log_drain(log, writer->fd);
+    return NULL;
+}
+
+// Запускает писателя журнала log в файловый дескриптор fd. Если журнал выключен, поток не создается.
+static inline void event_log_writer_start(event_log_writer_t *writer, event_log_t *log, int fd) {
+    writer->log = log;
+    writer->fd = fd;
+    writer->stopping = 0;
+
+    if (log == NULL) {
+        return;
+    }
+
+    // Поток писателя наследует маску сигналов: все сигналы обрабатывает основной поток, который и останавливает
+    // писателя из обработчика SIGTERM.
+    sigset_t signals, previous_signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+    pthread_create(&writer->thread, NULL, event_log_writer_run, writer);
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+}
+
+// Останавливает писателя, дождавшись вывода всех записей, и сообщает об отброшенных записях и байтах, которые
+// не удалось вывести.
+static inline void event_log_writer_stop(event_log_writer_t *writer) {
+    event_log_t *log = writer->log;
+    if (log == NULL) {
+        return;
+    }
+
+    __atomic_store_n(&writer->stopping, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&log->written, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &log->written, FUTEX_WAKE, 1, NULL, NULL, 0);
+    pthread_join(writer->thread, NULL);
+
+    char line[128];
+    uint64_t dropped = __atomic_load_n(&log->dropped, __ATOMIC_RELAXED);
+    if (dropped != 0) {
+        int length = snprintf(line, sizeof(line), "[LOG] dropped %llu records: the log ring was full.\n",
+                              (unsigned long long) dropped);
+        event_log_write_all(log, writer->fd, line, length);
+    }
+
+    uint64_t dropped_bytes = __atomic_load_n(&log->dropped_bytes, __ATOMIC_RELAXED);
+    if (dropped_bytes != 0) {
+        int length = snprintf(line, sizeof(line), "[LOG] lost %llu bytes: write to the log failed.\n",
+                              (unsigned long long) dropped_bytes);
+        event_log_write_all(log, writer->fd, line, length);
+    }
+
+    writer->log = NULL;
+}
+
+#endif //HW2_COMMON_EVENT_LOG_H
@@ -0,0 +1,184 @@
+#ifndef HW2_COMMON_HOTEL_CHECKOUTS_H
+#define HW2_COMMON_HOTEL_CHECKOUTS_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#include "checkout_heap.h"
+#include "rooms_segment.h"
+
+// Освобождает номер гостя, срок аренды которого истек. Вызывается потоком выездов.
+typedef void (*hotel_checkout_handler)(rooms_header_t *rooms, const rooms_checkout_t *checkout);
+
+// Поток выездов отеля. Клиенты, забронировав номер, не ждут окончания аренды сами, а кладут выезд в очередь
+// в сегменте (rooms_checkouts_push) и уходят. Поток забирает выезды в кучу, упорядоченную по времени окончания аренды,
+// как у демона на 9-10 баллов, и спит на futex очереди до ближайшего выезда или до нового выезда от клиента.
+// Поэтому число одновременно живущих гостей не ограничено ни числом потоков пула, ни числом процессов.
+typedef struct {
+    rooms_header_t *rooms;
+    hotel_checkout_handler handler;
+    // Куча хранит индексы выездов в pending, свободные индексы лежат в стеке free_ids.
+    checkout_heap_t heap;
+    rooms_checkout_t *pending;
+    int32_t *free_ids;
+    int pending_capacity;
+    int free_count;
+    pthread_t thread;
+    // 1 - выполнить все поручения и остановиться, 2 - остановиться сразу.
+    int stopping;
+    // Слово futex: поток выставляет его, закончив работу.
+    uint32_t finished;
+} hotel_checkouts_t;
+
+// Освобождает номер гостя под блокировкой шарда, отдает его листу ожидания и записывает выезд в журнал.
+static inline void hotel_checkouts_release(rooms_header_t *rooms, const rooms_checkout_t *checkout) {
+    rooms_segment_release(rooms, &checkout->booking, checkout->gender, 1);
+    rooms_waitlist_notify(rooms, 1);
+    event_log_write(rooms_segment_log(rooms), log_client_end_of_rent, checkout->client_id, 0, 0);
+    stats_count(&rooms_segment_stats(rooms)->released);
+}
+
+// Кладет выезд в кучу. Возвращает -1, если не хватило памяти.
+static inline int hotel_checkouts_schedule(hotel_checkouts_t *checkouts, const rooms_checkout_t *checkout) {
+    if (checkouts->free_count == 0) {
+        int capacity = checkouts->pending_capacity * 2;
+        rooms_checkout_t *pending = realloc(checkouts->pending, sizeof(rooms_checkout_t) * capacity);
+        if (pending == NULL) {
+            return -1;
+        }
+        checkouts->pending = pending;
+
+        int32_t *free_ids = realloc(checkouts->free_ids, sizeof(int32_t) * capacity);
+        if (free_ids == NULL) {
+            return -1;
+        }
+        checkouts->free_ids = free_ids;
+
+        for (int id = capacity - 1; id >= checkouts->pending_capacity; --id) {
+            checkouts->free_ids[checkouts->free_count++] = id;
+        }
+        checkouts->pending_capacity = capacity;
+    }
+
+    int32_t id = checkouts->free_ids[checkouts->free_count - 1];
+    if (checkout_heap_push(&checkouts->heap, id, (int64_t) checkout->expires_at) == -1) {
+        return -1;
+    }
+
+    checkouts->free_count--;
+    checkouts->pending[id] = *checkout;
+    return 0;
+}
+
+// Тело потока выездов.
+static inline void *hotel_checkouts_run(void *arg) {
+    hotel_checkouts_t *checkouts = arg;
+    rooms_header_t *rooms = checkouts->rooms;
+    rooms_checkout_t checkout;
+
+    while (1) {
+        // Выезд, которому не хватило места в куче, выполняется сразу: иначе номер остался бы занятым навсегда.
+        while (rooms_checkouts_pop(rooms, &checkout) == 0) {
+            if (hotel_checkouts_schedule(checkouts, &checkout) == -1) {
+                checkouts->handler(rooms, &checkout);
+            }
+        }
+
+        int64_t now = (int64_t) stats_now_ns();
+        while (checkouts->heap.count > 0 && checkouts->heap.items[0].expires_at <= now) {
+            int32_t id = checkouts->heap.items[0].id;
+            checkout_heap_pop(&checkouts->heap);
+            checkouts->handler(rooms, &checkouts->pending[id]);
+            checkouts->free_ids[checkouts->free_count++] = id;
+        }
+
+        // Флаг остановки читается после того, как поток объявил, что засыпает: остановка увеличивает слово futex,
+        // поэтому поток либо увидит флаг, либо проснется сразу. Выезды, которые клиенты поручили до остановки,
+        // видны в очереди после чтения флага.
+        uint32_t pushed = rooms_checkouts_prepare_wait(rooms);
+        int stopping = __atomic_load_n(&checkouts->stopping, __ATOMIC_ACQUIRE);
+
+        if (stopping == 2 || (stopping == 1 && checkouts->heap.count == 0 && rooms_checkouts_empty(rooms))) {
+            break;
+        }
+
+        int64_t next = checkout_heap_next(&checkouts->heap);
+        now = (int64_t) stats_now_ns();
+        rooms_checkouts_wait(rooms, pushed, next == -1 ? -1 : next > now ? next - now : 0);
+    }
+
+    __atomic_store_n(&checkouts->finished, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &checkouts->finished, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+    return NULL;
+}
+
+// Запускает поток выездов, который освобождает номера функцией handler. Возвращает -1, если не хватило памяти.
+static inline int hotel_checkouts_start(hotel_checkouts_t *checkouts, rooms_header_t *rooms,
+                                        hotel_checkout_handler handler) {
+    checkouts->handler = handler;
+    checkouts->pending_capacity = 16;
+    checkouts->free_count = 0;
+    checkouts->stopping = 0;
+    checkouts->finished = 0;
+    checkouts->pending = malloc(sizeof(rooms_checkout_t) * checkouts->pending_capacity);
+    checkouts->free_ids = malloc(sizeof(int32_t) * checkouts->pending_capacity);
+
+    if (checkout_heap_init(&checkouts->heap, checkouts->pending_capacity) == -1 || checkouts->pending == NULL ||
+        checkouts->free_ids == NULL) {
+        free(checkouts->pending);
+        free(checkouts->free_ids);
+        checkout_heap_free(&checkouts->heap);
+        return -1;
+    }
+
+    for (int id = checkouts->pending_capacity - 1; id >= 0; --id) {
+        checkouts->free_ids[checkouts->free_count++] = id;
+    }
+
+    // Поток наследует маску сигналов: все сигналы обрабатывает основной поток, который и останавливает поток
+    // выездов из обработчика SIGTERM.
+    sigset_t signals, previous_signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+    checkouts->rooms = rooms;
+    pthread_create(&checkouts->thread, NULL, hotel_checkouts_run, checkouts);
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+    return 0;
+}
+
+// Просит поток выездов выполнить все выезды, которые ему поручили, и остановиться. Не ждет потока: дождаться его можно
+// через hotel_checkouts_wait.
+static inline void hotel_checkouts_finish(hotel_checkouts_t *checkouts) {
+    __atomic_store_n(&checkouts->stopping, 1, __ATOMIC_RELEASE);
+    rooms_checkouts_wake(checkouts->rooms);
+}
+
+// Ждет, пока поток выездов не закончит работу. Возвращает 0, если поток закончил, или -1, если ожидание прервал
+// сигнал: так отель может напечатать статистику, запрошенную по SIGUSR1, и ждать дальше.
+static inline int hotel_checkouts_wait(hotel_checkouts_t *checkouts) {
+    if (__atomic_load_n(&checkouts->finished, __ATOMIC_ACQUIRE) == 0) {
+        syscall(SYS_futex, &checkouts->finished, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+    }
+
+    return __atomic_load_n(&checkouts->finished, __ATOMIC_ACQUIRE) ? 0 : -1;
+}
+
+// Останавливает поток выездов. Если finish не ноль, поток сначала выполняет все выезды, которые ему поручили,
+// дожидаясь окончания каждой аренды, иначе невыполненные выезды отбрасываются.
+static inline void hotel_checkouts_stop(hotel_checkouts_t *checkouts, int finish) {
+    if (checkouts->rooms == NULL) {
+        return;
+    }
+
+    __atomic_store_n(&checkouts->stopping, finish ? 1 : 2, __ATOMIC_RELEASE);
+    rooms_checkouts_wake(checkouts->rooms);
+    pthread_join(checkouts->thread, NULL);
+
+    free(checkouts->pending);
+    free(checkouts->free_ids);
+    checkout_heap_free(&checkouts->heap);
+    checkouts->rooms = NULL;
+}
+
+#endif //HW2_COMMON_HOTEL_CHECKOUTS_H
@@ -0,0 +1,253 @@
+#ifndef HW2_COMMON_HOTEL_ENGINE_H
+#define HW2_COMMON_HOTEL_ENGINE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkout_heap.h"
+#include "protocol.h"
+#include "rooms_segment.h"
+
+// Бронирование, которое отель помнит за клиентом. Пустая ячейка таблицы отмечается room_idx = -1.
+typedef struct {
+    int32_t client_id;
+    int32_t gender;
+    int32_t is_double;
+    int32_t room_idx;
+    // Момент окончания аренды в миллисекундах монотонных часов или 0, если срок не задан.
+    int64_t expires_at;
+} hotel_booking_t;
+
+// Распределитель номеров, принадлежащий процессу отеля. Только он принимает решения о заселении,
+// клиенты лишь присылают запросы, поэтому никаких блокировок внутри не требуется.
+typedef struct {
+    rooms_header_t *rooms;
+    rooms_view_t view;
+    // Открытая адресация с линейным пробированием по идентификатору клиента, размер - степень двойки.
+    hotel_booking_t *bookings;
+    int bookings_capacity;
+    int bookings_count;
+    // Куча выездов по идентификаторам клиентов. Ранний выезд из кучи не удаляется: устаревшая запись отбрасывается,
+    // когда до нее дойдет очередь.
+    checkout_heap_t checkouts;
+} hotel_engine_t;
+
+// Возвращает начальную ячейку клиента в таблице бронирований.
+static inline int hotel_engine_slot(const hotel_engine_t *engine, int32_t client_id) {
+    return (int) (((uint32_t) client_id * 2654435761u) & (uint32_t) (engine->bookings_capacity - 1));
+}
+
+// Создает состояние комнат и таблицу бронирований. Возвращает -1, если не хватило памяти.
+static inline int hotel_engine_init(hotel_engine_t *engine, const rooms_config_t *config) {
+    // Таблица заполняется не более чем наполовину: мест в отеле не больше single + 2 * double.
+    int places = config->single_rooms_count + config->double_rooms_count * 2;
+    engine->bookings_capacity = 16;
+    while (engine->bookings_capacity < places * 2) {
+        engine->bookings_capacity *= 2;
+    }
+
+    engine->bookings_count = 0;
+    // Номера меняет только процесс отеля, блокировки не нужны, поэтому все номера лежат в одном шарде.
+    // Лист ожидания и кольцо журнала в общей памяти рассчитаны на клиентов, которые сами бронируют номера, демону они
+    // не нужны.
+    rooms_config_t rooms_config = *config;
+    rooms_config.shards_count = 1;
+    rooms_config.waitlist_capacity = 0;
+    rooms_config.log_level = log_level_off;
+    engine->rooms = aligned_alloc(CACHE_LINE_SIZE, rooms_segment_size(&rooms_config));
+    engine->bookings = malloc(sizeof(hotel_booking_t) * engine->bookings_capacity);
+
+    if (checkout_heap_init(&engine->checkouts, places) == -1 || engine->rooms == NULL || engine->bookings == NULL) {
+        free(engine->rooms);
+        free(engine->bookings);
+        checkout_heap_free(&engine->checkouts);
+        return -1;
+    }
+
+    for (int i = 0; i < engine->bookings_capacity; ++i) {
+        engine->bookings[i].room_idx = -1;
+    }
+
+    rooms_segment_init(engine->rooms, &rooms_config);
+    engine->view = rooms_segment_view(engine->rooms, 0);
+    return 0;
+}
+
+// Освобождает память распределителя.
+static inline void hotel_engine_free(hotel_engine_t *engine) {
+    free(engine->rooms);
+    free(engine->bookings);
+    checkout_heap_free(&engine->checkouts);
+    engine->rooms = NULL;
+    engine->bookings = NULL;
+}
+
+// Возвращает ячейку с бронированием клиента или -1, если клиент ничего не бронировал.
+static inline int hotel_engine_find(const hotel_engine_t *engine, int32_t client_id) {
+    int mask = engine->bookings_capacity - 1;
+
+    for (int slot = hotel_engine_slot(engine, client_id);; slot = (slot + 1) & mask) {
+        if (engine->bookings[slot].room_idx == -1) {
+            return -1;
+        } else if (engine->bookings[slot].client_id == client_id) {
+            return slot;
+        }
+    }
+}
+
+// Удаляет бронирование из ячейки slot, сдвигая назад следующие за ним элементы цепочки.
+static inline void hotel_engine_forget(hotel_engine_t *engine, int slot) {
+    int mask = engine->bookings_capacity - 1;
+    int hole = slot;
+
+    for (int next = (hole + 1) & mask; engine->bookings[next].room_idx != -1; next = (next + 1) & mask) {
+        int home = hotel_engine_slot(engine, engine->bookings[next].client_id);
+
+        // Элемент можно перенести в дыру, только если его начальная ячейка не лежит между дырой и ним.
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            engine->bookings[hole] = engine->bookings[next];
+            hole = next;
+        }
+    }
+
+    engine->bookings[hole].room_idx = -1;
+    engine->bookings_count--;
+}
+
+// Возвращает момент ближайшего выезда или -1, если выездов не запланировано.
+static inline int64_t hotel_engine_next_checkout(const hotel_engine_t *engine) {
+    return checkout_heap_next(&engine->checkouts);
+}
+
+// Запоминает бронирование клиента, номер которого уже занят. Если expires_at не ноль, планирует выезд на этот
+// момент.
+static inline void hotel_engine_remember(hotel_engine_t *engine, int32_t client_id, int32_t gender, int32_t is_double,
+                                         int32_t room_idx, int64_t expires_at) {
+    int mask = engine->bookings_capacity - 1;
+    int slot = hotel_engine_slot(engine, client_id);
+
+    while (engine->bookings[slot].room_idx != -1) {
+        slot = (slot + 1) & mask;
+    }
+
+    engine->bookings[slot].client_id = client_id;
+    engine->bookings[slot].gender = gender;
+    engine->bookings[slot].is_double = is_double;
+    engine->bookings[slot].room_idx = room_idx;
+    engine->bookings[slot].expires_at = 0;
+    engine->bookings_count++;
+
+    if (expires_at != 0 && checkout_heap_push(&engine->checkouts, client_id, expires_at) == 0) {
+        engine->bookings[slot].expires_at = expires_at;
+    }
+}
+
+// Подбирает номер клиенту: сначала одноместный, затем двухместный - пустой или с соседом того же пола.
+// Если в запросе задан срок аренды, отель сам освободит номер по его истечении.
+static inline void hotel_engine_book(hotel_engine_t *engine, const hotel_request_t *request, hotel_reply_t *reply,
+                                     int64_t now) {
+    room_status previous_status = freed;
+    reply->result = -1;
+
+    // Повторный запрос от клиента, у которого уже есть номер, и запрос с некорректным сроком аренды отклоняются.
+    if (request->rent_time < 0 || request->rent_time > PROTOCOL_MAX_RENT_TIME ||
+        hotel_engine_find(engine, request->client_id) != -1) {
+        return;
+    }
+
+    reply->room_idx = rooms_book_single(&engine->view);
+
+    if (reply->room_idx == -1) {
+        reply->is_double = 1;
+        reply->room_idx = rooms_book_double(&engine->view, request->gender, &previous_status);
+    }
+
+    reply->previous_status = previous_status;
+
+    if (reply->room_idx >= 0) {
+        int64_t expires_at = request->rent_time > 0 ? now + (int64_t) request->rent_time * 1000 : 0;
+        hotel_engine_remember(engine, request->client_id, request->gender, reply->is_double, reply->room_idx,
+                              expires_at);
+        reply->result = 0;
+    }
+}
+
+// Освобождает номер из бронирования в ячейке slot и забывает бронирование.
+static inline void hotel_engine_checkout(hotel_engine_t *engine, int slot) {
+    hotel_booking_t booking = engine->bookings[slot];
+
+    if (booking.is_double) {
+        rooms_release_double(&engine->view, booking.room_idx, booking.gender);
+    } else {
+        rooms_release_single(&engine->view, booking.room_idx);
+    }
+
+    hotel_engine_forget(engine, slot);
+}
+
+// Освобождает номер клиента. Номер берется из таблицы бронирований, а присланные тип и индекс лишь сверяются с ней,
+// поэтому ошибочный запрос не может освободить чужой номер.
+static inline void hotel_engine_release(hotel_engine_t *engine, const hotel_request_t *request, hotel_reply_t *reply) {
+    int slot = hotel_engine_find(engine, request->client_id);
+    reply->result = -1;
+
+    if (slot == -1) {
+        return;
+    }
+
+    hotel_booking_t booking = engine->bookings[slot];
+    reply->is_double = booking.is_double;
+    reply->room_idx = booking.room_idx;
+
+    if (request->room_idx != booking.room_idx || request->is_double != booking.is_double) {
+        return;
+    }
+
+    hotel_engine_checkout(engine, slot);
+    reply->result = 0;
+}
+
+// Выселяет одного гостя, срок аренды которого истек к моменту now, и записывает его бронирование в booking.
+// Возвращает 0, если таких гостей больше нет.
+static inline int hotel_engine_expire(hotel_engine_t *engine, int64_t now, hotel_booking_t *booking) {
+    while (engine->checkouts.count > 0 && engine->checkouts.items[0].expires_at <= now) {
+        hotel_checkout_t checkout = engine->checkouts.items[0];
+        int slot = hotel_engine_find(engine, checkout.id);
+        checkout_heap_pop(&engine->checkouts);
+
+        // Гость мог выехать раньше срока или уже заселиться заново с другим сроком.
+        if (slot != -1 && engine->bookings[slot].expires_at == checkout.expires_at) {
+            *booking = engine->bookings[slot];
+            hotel_engine_checkout(engine, slot);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Выполняет запрос клиента, поступивший в момент now, и заполняет ответ. Возвращает 1, если клиент ждет ответа:
+// на packet_release отель не отвечает.
+static inline int hotel_engine_handle(hotel_engine_t *engine, const hotel_request_t *request, hotel_reply_t *reply,
+                                      int64_t now) {
+    memset(reply, 0, sizeof(hotel_reply_t));
+    reply->packet_id = request->packet_id;
+    reply->client_id = request->client_id;
+    reply->room_idx = -1;
+    reply->single_rooms_count = engine->rooms->single_rooms_count;
+    reply->double_rooms_count = engine->rooms->double_rooms_count;
+
+    if (request->packet_id == packet_book) {
+        hotel_engine_book(engine, request, reply, now);
+    } else if (request->packet_id == packet_release) {
+        hotel_engine_release(engine, request, reply);
+        return 0;
+    } else if (request->packet_id != packet_query) {
+        // На packet_query отель отвечает только размерами, остальные пакеты неизвестны.
+        reply->result = -1;
+    }
+
+    return 1;
+}
+
+#endif //HW2_COMMON_HOTEL_ENGINE_H
@@ -0,0 +1,71 @@
+#ifndef HW2_COMMON_IO_H
+#define HW2_COMMON_IO_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// Читает из дескриптора ровно size байт. Большие сообщения приходят из канала частями, поэтому read повторяется.
+// Возвращает 0 при успехе и -1, если канал закрыт или произошла ошибка.
+static inline int read_full(int fd, void *buffer, size_t size) {
+    char *position = buffer;
+
+    while (size > 0) {
+        ssize_t count = read(fd, position, size);
+
+        if (count == -1 && errno == EINTR) {
+            continue;
+        } else if (count <= 0) {
+            return -1;
+        }
+
+        position += count;
+        size -= (size_t) count;
+    }
+
+    return 0;
+}
+
+// Записывает в дескриптор ровно size байт.
+static inline int write_full(int fd, const void *buffer, size_t size) {
+    const char *position = buffer;
+
+    while (size > 0) {
+        ssize_t count = write(fd, position, size);
+
+        if (count == -1 && errno == EINTR) {
+            continue;
+        } else if (count <= 0) {
+            return -1;
+        }
+
+        position += count;
+        size -= (size_t) count;
+    }
+
+    return 0;
+}
+
+// Читает из канала все уже доступные записи размера record_size, но не больше count, одним вызовом read.
+// Блокируется, только пока канал пуст; запись, пришедшая частично, дочитывается целиком.
+// Возвращает число прочитанных записей или -1, если канал закрыт или произошла ошибка.
+static inline ssize_t read_records(int fd, void *buffer, size_t record_size, size_t count) {
+    ssize_t size;
+
+    do {
+        size = read(fd, buffer, record_size * count);
+    } while (size == -1 && errno == EINTR);
+
+    if (size <= 0) {
+        return -1;
+    }
+
+    size_t tail = (size_t) size % record_size;
+    if (tail > 0 && read_full(fd, (char *) buffer + size, record_size - tail) == -1) {
+        return -1;
+    }
+
+    return (ssize_t) (((size_t) size + record_size - 1) / record_size);
+}
+
+#endif //HW2_COMMON_IO_H
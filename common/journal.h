@@ -0,0 +1,265 @@
+#ifndef HW2_COMMON_JOURNAL_H
+#define HW2_COMMON_JOURNAL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hotel_engine.h"
+
+#define JOURNAL_MAGIC 0x4c4e524au
+#define JOURNAL_VERSION 1
+// На сколько записей файл журнала увеличивается, когда место заканчивается.
+#define JOURNAL_GROW_RECORDS 65536
+
+// Событие журнала отеля.
+typedef enum {
+    // Клиент заселился.
+    journal_book,
+    // Клиенту не хватило номера.
+    journal_reject,
+    // Клиент выехал сам.
+    journal_release,
+    // Отель выселил клиента по окончании аренды.
+    journal_checkout
+} journal_event;
+
+// Запись журнала фиксированного размера.
+typedef struct {
+    // Момент события в миллисекундах настенных часов: в отличие от монотонных, они сравнимы между запусками отеля.
+    int64_t time_ms;
+    uint32_t event;
+    int32_t client_id;
+    int32_t gender;
+    int32_t is_double;
+    int32_t room_idx;
+    // Срок аренды заселившегося клиента в миллисекундах или 0, если отель не выселяет его сам.
+    int32_t rent_ms;
+} journal_record_t;
+
+// Заголовок файла журнала. За ним идут записи, число записанных хранится в records_count: запись сначала
+// заполняется, а потом учитывается в счетчике, поэтому после падения отеля недописанная запись просто не видна.
+typedef struct CACHE_LINE_ALIGNED {
+    uint32_t magic;
+    uint32_t version;
+    int32_t single_rooms_count;
+    int32_t double_rooms_count;
+    uint64_t records_count;
+} journal_header_t;
+
+// Журнал, отображенный в память. Отель дописывает записи прямо в отображение, а ядро само сбрасывает страницы в
+// файл: запись события - это копирование 32 байт без системного вызова, и завершение процесса записи не теряет.
+typedef struct {
+    int fd;
+    journal_header_t *header;
+    // Сколько записей помещается в отображенный файл.
+    uint64_t capacity;
+    int writable;
+} journal_t;
+
+// Возвращает текущее время настенных часов в миллисекундах.
+static inline int64_t journal_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Возвращает размер файла с местом под capacity записей.
+static inline size_t journal_file_size(uint64_t capacity) {
+    return sizeof(journal_header_t) + sizeof(journal_record_t) * capacity;
+}
+
+// Возвращает записи журнала.
+static inline journal_record_t *journal_records(const journal_t *journal) {
+    return (journal_record_t *) (journal->header + 1);
+}
+
+// Отображает файл размером size и проверяет заголовок. Возвращает -1, если файл не является журналом.
+static inline int journal_map(journal_t *journal, size_t size) {
+    int protection = journal->writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    journal->header = mmap(NULL, size, protection, MAP_SHARED, journal->fd, 0);
+
+    if (journal->header == MAP_FAILED) {
+        journal->header = NULL;
+        return -1;
+    }
+
+    journal->capacity = (size - sizeof(journal_header_t)) / sizeof(journal_record_t);
+    if (journal->header->magic != JOURNAL_MAGIC || journal->header->version != JOURNAL_VERSION ||
+        journal->header->records_count > journal->capacity) {
+        munmap(journal->header, size);
+        journal->header = NULL;
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Открывает журнал для чтения. Возвращает -1, если файл не открылся или не является журналом.
+static inline int journal_open_readonly(journal_t *journal, const char *path) {
+    struct stat file_stat;
+    journal->writable = 0;
+    journal->header = NULL;
+    journal->fd = open(path, O_RDONLY);
+
+    if (journal->fd == -1) {
+        return -1;
+    }
+
+    if (fstat(journal->fd, &file_stat) == -1) {
+        close(journal->fd);
+        return -1;
+    }
+
+    if ((size_t) file_stat.st_size < sizeof(journal_header_t) || journal_map(journal, file_stat.st_size) == -1) {
+        close(journal->fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Открывает журнал для дописывания, создавая его, если файла еще нет. Журнал прежнего запуска сохраняется, только
+// если отель запущен с тем же числом номеров, иначе возвращается -1 и errno = EINVAL.
+static inline int journal_open(journal_t *journal, const char *path, int single_rooms_count, int double_rooms_count) {
+    struct stat file_stat;
+    journal->writable = 1;
+    journal->header = NULL;
+    journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (journal->fd == -1 || fstat(journal->fd, &file_stat) == -1) {
+        return -1;
+    }
+
+    if (file_stat.st_size == 0) {
+        journal_header_t header;
+        memset(&header, 0, sizeof(header));
+        header.magic = JOURNAL_MAGIC;
+        header.version = JOURNAL_VERSION;
+        header.single_rooms_count = single_rooms_count;
+        header.double_rooms_count = double_rooms_count;
+
+        if (ftruncate(journal->fd, journal_file_size(JOURNAL_GROW_RECORDS)) == -1 ||
+            pwrite(journal->fd, &header, sizeof(header), 0) != sizeof(header)) {
+            close(journal->fd);
+            return -1;
+        }
+
+        file_stat.st_size = journal_file_size(JOURNAL_GROW_RECORDS);
+    }
+
+    if ((size_t) file_stat.st_size < sizeof(journal_header_t) || journal_map(journal, file_stat.st_size) == -1) {
+        close(journal->fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (journal->header->single_rooms_count != single_rooms_count ||
+        journal->header->double_rooms_count != double_rooms_count) {
+        munmap(journal->header, file_stat.st_size);
+        journal->header = NULL;
+        close(journal->fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Дописывает запись в журнал, увеличивая файл, если место закончилось. Возвращает -1, если файл увеличить не удалось.
+static inline int journal_append(journal_t *journal, const journal_record_t *record) {
+    uint64_t count = journal->header->records_count;
+
+    // Файл увеличивается большими шагами и отображается заново. Записанное уже лежит в файле, поэтому прежнее
+    // отображение просто снимается.
+    if (count == journal->capacity) {
+        size_t new_size = journal_file_size(journal->capacity + JOURNAL_GROW_RECORDS);
+
+        if (ftruncate(journal->fd, new_size) == -1) {
+            return -1;
+        }
+
+        journal_header_t *header = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, 0);
+        if (header == MAP_FAILED) {
+            return -1;
+        }
+
+        munmap(journal->header, journal_file_size(journal->capacity));
+        journal->header = header;
+        journal->capacity += JOURNAL_GROW_RECORDS;
+    }
+
+    journal_records(journal)[count] = *record;
+    __atomic_store_n(&journal->header->records_count, count + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Закрывает журнал. Файл журнала, открытого для дописывания, обрезается до записанных записей.
+static inline void journal_close(journal_t *journal) {
+    if (journal->header == NULL) {
+        return;
+    }
+
+    uint64_t count = journal->header->records_count;
+    munmap(journal->header, journal_file_size(journal->capacity));
+
+    if (journal->writable) {
+        ftruncate(journal->fd, journal_file_size(count));
+    }
+
+    close(journal->fd);
+    journal->header = NULL;
+}
+
+// Применяет запись журнала к распределителю номеров. Заселение занимает тот же номер, что и в журнале, а выезд
+// освобождает его. Если now_ms не меньше нуля, выезды по окончании аренды планируются заново: now_ms и now_real_ms -
+// текущие показания монотонных и настенных часов, а выезд, который должен был случиться, пока отель не работал,
+// произойдет сразу. Возвращает -1, если запись противоречит состоянию номеров.
+static inline int journal_apply(hotel_engine_t *engine, const journal_record_t *record, int64_t now_ms,
+                                int64_t now_real_ms) {
+    rooms_view_t *view = &engine->view;
+
+    if (record->event == journal_reject) {
+        return 0;
+    } else if (record->event == journal_book) {
+        int rooms_count = record->is_double ? view->double_rooms_count : view->single_rooms_count;
+
+        if (record->room_idx < 0 || record->room_idx >= rooms_count ||
+            hotel_engine_find(engine, record->client_id) != -1 ||
+            rooms_occupy(view, record->is_double, record->room_idx, record->gender) == -1) {
+            return -1;
+        }
+
+        int64_t expires_at = 0;
+        if (record->rent_ms > 0 && now_ms >= 0) {
+            int64_t left_ms = record->time_ms + record->rent_ms - now_real_ms;
+            expires_at = now_ms + (left_ms > 0 ? left_ms : 0);
+            expires_at = expires_at > 0 ? expires_at : 1;
+        }
+
+        hotel_engine_remember(engine, record->client_id, record->gender, record->is_double, record->room_idx,
+                              expires_at);
+        return 0;
+    } else if (record->event == journal_release || record->event == journal_checkout) {
+        int slot = hotel_engine_find(engine, record->client_id);
+
+        if (slot == -1 || engine->bookings[slot].room_idx != record->room_idx ||
+            engine->bookings[slot].is_double != record->is_double) {
+            return -1;
+        }
+
+        hotel_engine_checkout(engine, slot);
+        return 0;
+    }
+
+    return -1;
+}
+
+#endif //HW2_COMMON_JOURNAL_H
@@ -0,0 +1,50 @@
+#ifndef HW2_COMMON_PROTOCOL_H
+#define HW2_COMMON_PROTOCOL_H
+
+#include <stdint.h>
+
+#include "rooms.h"
+
+// Наибольший срок аренды в секундах: в журнале отеля он хранится в миллисекундах в int32_t.
+#define PROTOCOL_MAX_RENT_TIME (INT32_MAX / 1000)
+
+// Типы запросов к отелю, работающему через именованные каналы.
+typedef enum {
+    // Запрос размеров отеля.
+    packet_query = 1,
+    // Бронирование номера клиентом указанного пола.
+    packet_book = 3,
+    // Освобождение ранее забронированного номера.
+    packet_release = 4
+} packet_type;
+
+// Запрос клиента. Состояние номеров по каналу больше не передается, решение о заселении принимает отель.
+typedef struct {
+    int32_t packet_id;
+    int32_t client_id;
+    // Идентификатор канала, в который клиент ждет ответ (обычно pid клиента).
+    int32_t reply_id;
+    int32_t gender;
+    // Для packet_release: тип и индекс освобождаемого номера.
+    int32_t is_double;
+    int32_t room_idx;
+    // Для packet_book: срок аренды в секундах, по истечении которого отель сам освободит номер (0 - без срока).
+    // Запрос со сроком меньше нуля или больше PROTOCOL_MAX_RENT_TIME отклоняется.
+    int32_t rent_time;
+} hotel_request_t;
+
+// Ответ отеля на запрос.
+typedef struct {
+    int32_t packet_id;
+    int32_t client_id;
+    // 0 - запрос выполнен, -1 - свободных номеров нет или запрос некорректен.
+    int32_t result;
+    int32_t is_double;
+    int32_t room_idx;
+    // Статус двухместного номера до заселения: freed или номер с соседом того же пола.
+    int32_t previous_status;
+    int32_t single_rooms_count;
+    int32_t double_rooms_count;
+} hotel_reply_t;
+
+#endif //HW2_COMMON_PROTOCOL_H
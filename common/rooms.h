@@ -0,0 +1,510 @@
+#ifndef HW2_COMMON_ROOMS_H
+#define HW2_COMMON_ROOMS_H
+
+#include <stdint.h>
+
+// Количество 64-битных слов нижнего уровня битовой карты на count элементов.
+#define ROOM_BITMAP_WORDS(count) (((count) + 63) / 64)
+// Полный размер битовой карты в словах: нижний уровень и слова-сводки (бит на каждое непустое слово).
+#define ROOM_BITMAP_SIZE(count) (ROOM_BITMAP_WORDS(count) + (ROOM_BITMAP_WORDS(count) + 63) / 64)
+// Количество 64-битных слов, в которые упаковываются статусы count номеров (по 2 бита на номер).
+#define ROOM_PACKED_WORDS(count) (((count) + 31) / 32)
+// Младшие биты всех 2-битных полей слова.
+#define ROOM_STATUS_LOW_BITS 0x5555555555555555ULL
+
+// Статус комнаты. Хранится упакованным по 2 бита, поэтому значений не может быть больше четырех.
+typedef enum {
+    freed,
+    busied_by_man,
+    busied_by_woman,
+    full
+} room_status;
+
+// Способ синхронизации доступа к номерам.
+typedef enum {
+    // Все операции выполняются под общим семафором.
+    booking_with_lock,
+    // Каждый статус номера меняется атомарной операцией compare-and-swap, семафор не используется.
+    booking_with_cas
+} booking_mode;
+
+// Число номеров каждого статуса, отдельно одноместных и двухместных (статус full не считается). Счетчики меняются
+// вместе со статусами и читаются без блокировки: по ним сразу видно, есть ли подходящее место, без просмотра номеров.
+typedef struct {
+    int32_t single_rooms[4];
+    int32_t double_rooms[4];
+} rooms_vacancy_t;
+
+// Представление состояния комнат в адресном пространстве текущего процесса.
+// Сами массивы лежат в разделяемой памяти (или в буфере сообщения), поэтому указатели строятся каждым процессом заново.
+typedef struct {
+    // Упакованные статусы номеров, по 32 номера в слове.
+    uint64_t *single_rooms;
+    uint64_t *double_rooms;
+    // Битовые карты слов, в которых есть свободные одноместные, свободные двухместные и наполовину занятые
+    // двухместные номера (один бит на слово упакованных статусов).
+    uint64_t *free_single_rooms;
+    uint64_t *free_double_rooms;
+    uint64_t *man_double_rooms;
+    uint64_t *woman_double_rooms;
+    rooms_vacancy_t *vacancy;
+    int single_rooms_count;
+    int double_rooms_count;
+} rooms_view_t;
+
+// Возвращает статус номера idx из упакованного массива.
+static inline room_status room_status_get(const uint64_t *packed, int idx) {
+    return (room_status) (packed[idx / 32] >> (idx % 32 * 2) & 3);
+}
+
+// Записывает статус номера idx в упакованный массив.
+static inline void room_status_set(uint64_t *packed, int idx, room_status status) {
+    int shift = idx % 32 * 2;
+    packed[idx / 32] = (packed[idx / 32] & ~(3ULL << shift)) | ((uint64_t) status << shift);
+}
+
+// Возвращает маску, в которой младший бит 2-битного поля выставлен, если номер в слове имеет статус status.
+static inline uint64_t room_status_mask(uint64_t word, room_status status) {
+    uint64_t difference = word ^ (ROOM_STATUS_LOW_BITS * status);
+    return ~(difference | difference >> 1) & ROOM_STATUS_LOW_BITS;
+}
+
+// Помечает элемент idx в битовой карте.
+static inline void room_bitmap_set(uint64_t *bitmap, int count, int idx) {
+    uint64_t *summary = bitmap + ROOM_BITMAP_WORDS(count);
+    bitmap[idx / 64] |= 1ULL << (idx % 64);
+    summary[idx / 4096] |= 1ULL << (idx / 64 % 64);
+}
+
+// Снимает отметку элемента idx в битовой карте.
+static inline void room_bitmap_clear(uint64_t *bitmap, int count, int idx) {
+    uint64_t *summary = bitmap + ROOM_BITMAP_WORDS(count);
+    bitmap[idx / 64] &= ~(1ULL << (idx % 64));
+
+    if (bitmap[idx / 64] == 0) {
+        summary[idx / 4096] &= ~(1ULL << (idx / 64 % 64));
+    }
+}
+
+// Возвращает индекс первого отмеченного элемента или -1, если таких нет.
+// Просматриваются только слова-сводки, поэтому поиск стоит count / 4096 итераций вместо count.
+static inline int room_bitmap_find_first(const uint64_t *bitmap, int count) {
+    const uint64_t *summary = bitmap + ROOM_BITMAP_WORDS(count);
+    int summary_words = ROOM_BITMAP_SIZE(count) - ROOM_BITMAP_WORDS(count);
+
+    for (int i = 0; i < summary_words; ++i) {
+        if (summary[i] != 0) {
+            int word = i * 64 + __builtin_ctzll(summary[i]);
+            return word * 64 + __builtin_ctzll(bitmap[word]);
+        }
+    }
+
+    return -1;
+}
+
+// Возвращает битовую карту, в которой отмечаются слова с номерами указанного статуса, или NULL.
+static inline uint64_t *rooms_status_bitmap(const rooms_view_t *view, int is_double, room_status status) {
+    if (!is_double) {
+        return status == freed ? view->free_single_rooms : NULL;
+    }
+
+    switch (status) {
+        case freed:
+            return view->free_double_rooms;
+        case busied_by_man:
+            return view->man_double_rooms;
+        case busied_by_woman:
+            return view->woman_double_rooms;
+        default:
+            return NULL;
+    }
+}
+
+// Приводит отметку слова word в битовой карте статуса status к фактическому содержимому слова.
+static inline void rooms_bitmap_update(const rooms_view_t *view, int is_double, int word, room_status status) {
+    uint64_t *bitmap = rooms_status_bitmap(view, is_double, status);
+    uint64_t *packed = is_double ? view->double_rooms : view->single_rooms;
+    int words = ROOM_PACKED_WORDS(is_double ? view->double_rooms_count : view->single_rooms_count);
+
+    if (bitmap == NULL) {
+        return;
+    } else if (room_status_mask(packed[word], status) != 0) {
+        room_bitmap_set(bitmap, words, word);
+    } else {
+        room_bitmap_clear(bitmap, words, word);
+    }
+}
+
+// Возвращает счетчик номеров со статусом status. Без блокировки значение может уже устареть, но не бывает
+// прочитано наполовину.
+static inline int rooms_vacancy_get(const rooms_view_t *view, int is_double, room_status status) {
+    int32_t *counters = is_double ? view->vacancy->double_rooms : view->vacancy->single_rooms;
+    return __atomic_load_n(&counters[status], __ATOMIC_RELAXED);
+}
+
+// Учитывает переход номера из статуса previous в status. Счетчики меняются атомарно, потому что в режиме
+// booking_with_cas номера одного шарда одновременно меняют несколько клиентов.
+static inline void rooms_vacancy_update(const rooms_view_t *view, int is_double, room_status previous,
+                                        room_status status) {
+    int32_t *counters = is_double ? view->vacancy->double_rooms : view->vacancy->single_rooms;
+
+    if (previous != full) {
+        __atomic_fetch_sub(&counters[previous], 1, __ATOMIC_RELAXED);
+    }
+
+    if (status != full) {
+        __atomic_fetch_add(&counters[status], 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Проверяет по счетчикам, найдется ли место клиенту указанного пола: свободный одноместный номер, пустой
+// двухместный или двухместный с соседом того же пола.
+static inline int rooms_has_vacancy(const rooms_view_t *view, int gender) {
+    return rooms_vacancy_get(view, 0, freed) > 0 || rooms_vacancy_get(view, 1, freed) > 0 ||
+           rooms_vacancy_get(view, 1, gender == 0 ? busied_by_man : busied_by_woman) > 0;
+}
+
+// Возвращает статус номера.
+static inline room_status rooms_get_status(const rooms_view_t *view, int is_double, int idx) {
+    return room_status_get(is_double ? view->double_rooms : view->single_rooms, idx);
+}
+
+// Меняет статус номера и обновляет битовые карты.
+static inline void rooms_set_status(const rooms_view_t *view, int is_double, int idx, room_status status) {
+    room_status previous = rooms_get_status(view, is_double, idx);
+    room_status_set(is_double ? view->double_rooms : view->single_rooms, idx, status);
+    rooms_vacancy_update(view, is_double, previous, status);
+    rooms_bitmap_update(view, is_double, idx / 32, previous);
+    rooms_bitmap_update(view, is_double, idx / 32, status);
+}
+
+// Возвращает первый номер с указанным статусом или -1, если таких нет.
+static inline int rooms_find(const rooms_view_t *view, int is_double, room_status status) {
+    uint64_t *packed = is_double ? view->double_rooms : view->single_rooms;
+    int words = ROOM_PACKED_WORDS(is_double ? view->double_rooms_count : view->single_rooms_count);
+    int word = room_bitmap_find_first(rooms_status_bitmap(view, is_double, status), words);
+
+    if (word == -1) {
+        return -1;
+    }
+
+    return word * 32 + __builtin_ctzll(room_status_mask(packed[word], status)) / 2;
+}
+
+// Помечает все номера свободными. Хвост последнего слова заполняется статусом full, чтобы его никто не занял.
+static inline void rooms_init(const rooms_view_t *view) {
+    for (int is_double = 0; is_double < 2; ++is_double) {
+        uint64_t *packed = is_double ? view->double_rooms : view->single_rooms;
+        int32_t *counters = is_double ? view->vacancy->double_rooms : view->vacancy->single_rooms;
+        int count = is_double ? view->double_rooms_count : view->single_rooms_count;
+
+        for (room_status status = freed; status <= full; ++status) {
+            counters[status] = status == freed ? count : 0;
+        }
+
+        for (int i = 0; i < ROOM_PACKED_WORDS(count); ++i) {
+            packed[i] = 0;
+        }
+
+        for (int i = count; i < ROOM_PACKED_WORDS(count) * 32; ++i) {
+            room_status_set(packed, i, full);
+        }
+
+        for (int i = 0; i < ROOM_PACKED_WORDS(count); ++i) {
+            rooms_bitmap_update(view, is_double, i, freed);
+        }
+    }
+}
+
+// Приводит все битовые карты и счетчики к упакованным статусам. Нужна, если процесс завершился посреди изменения
+// статуса: сам статус записывается одной операцией, а отметки в битовых картах и счетчики могли остаться прежними.
+static inline void rooms_repair(const rooms_view_t *view) {
+    for (int is_double = 0; is_double < 2; ++is_double) {
+        uint64_t *packed = is_double ? view->double_rooms : view->single_rooms;
+        int32_t *counters = is_double ? view->vacancy->double_rooms : view->vacancy->single_rooms;
+        int count = is_double ? view->double_rooms_count : view->single_rooms_count;
+
+        for (room_status status = freed; status <= full; ++status) {
+            counters[status] = 0;
+        }
+
+        for (int i = 0; i < ROOM_PACKED_WORDS(count); ++i) {
+            for (room_status status = freed; status < full; ++status) {
+                counters[status] += __builtin_popcountll(room_status_mask(packed[i], status));
+                rooms_bitmap_update(view, is_double, i, status);
+            }
+        }
+    }
+}
+
+// Бронирует первый свободный одноместный номер. Возвращает его индекс или -1.
+static inline int rooms_book_single(const rooms_view_t *view) {
+    if (rooms_vacancy_get(view, 0, freed) == 0) {
+        return -1;
+    }
+
+    int idx = rooms_find(view, 0, freed);
+
+    if (idx >= 0) {
+        rooms_set_status(view, 0, idx, full);
+    }
+
+    return idx;
+}
+
+// Бронирует первый двухместный номер, который либо пуст, либо занят человеком того же пола.
+// В previous записывается статус номера до заселения. Возвращает индекс номера или -1.
+static inline int rooms_book_double(const rooms_view_t *view, int gender, room_status *previous) {
+    room_status busied = gender == 0 ? busied_by_man : busied_by_woman;
+    int free_idx = rooms_vacancy_get(view, 1, freed) > 0 ? rooms_find(view, 1, freed) : -1;
+    int half_idx = rooms_vacancy_get(view, 1, busied) > 0 ? rooms_find(view, 1, busied) : -1;
+
+    // Как и при последовательном просмотре, выбираем подходящий номер с наименьшим индексом.
+    if (half_idx >= 0 && (free_idx == -1 || half_idx < free_idx)) {
+        *previous = busied;
+        rooms_set_status(view, 1, half_idx, full);
+        return half_idx;
+    }
+
+    if (free_idx >= 0) {
+        *previous = freed;
+        rooms_set_status(view, 1, free_idx, busied);
+    }
+
+    return free_idx;
+}
+
+// Освобождает одноместный номер.
+static inline void rooms_release_single(const rooms_view_t *view, int idx) {
+    rooms_set_status(view, 0, idx, freed);
+}
+
+// Освобождает место в двухместном номере, которое занимал человек указанного пола.
+static inline void rooms_release_double(const rooms_view_t *view, int idx, int gender) {
+    room_status status = rooms_get_status(view, 1, idx);
+
+    if (status == full) {
+        rooms_set_status(view, 1, idx, gender == 0 ? busied_by_man : busied_by_woman);
+    } else if (status == busied_by_man || status == busied_by_woman) {
+        rooms_set_status(view, 1, idx, freed);
+    }
+}
+
+// Заселяет человека указанного пола в конкретный номер, как если бы его выбрал поиск. Нужна, чтобы восстановить
+// заселения из журнала. Возвращает -1, если номер занят или в нем живет человек другого пола.
+static inline int rooms_occupy(const rooms_view_t *view, int is_double, int idx, int gender) {
+    room_status busied = gender == 0 ? busied_by_man : busied_by_woman;
+    room_status status = rooms_get_status(view, is_double, idx);
+
+    if (status == freed) {
+        rooms_set_status(view, is_double, idx, is_double ? busied : full);
+    } else if (is_double && status == busied) {
+        rooms_set_status(view, is_double, idx, full);
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Далее идут версии операций для режима booking_with_cas. В нем источником истины являются упакованные статусы,
+// которые меняются только через compare-and-swap, а битовые карты служат подсказками: отметка может ненадолго
+// оказаться лишней (тогда слово будет просмотрено зря и отметка снимется), но у подходящего слова не пропадает.
+
+// Атомарно помечает элемент idx в битовой карте.
+static inline void room_bitmap_set_atomic(uint64_t *bitmap, int count, int idx) {
+    uint64_t *summary = bitmap + ROOM_BITMAP_WORDS(count);
+    __atomic_fetch_or(&bitmap[idx / 64], 1ULL << (idx % 64), __ATOMIC_SEQ_CST);
+    __atomic_fetch_or(&summary[idx / 4096], 1ULL << (idx / 64 % 64), __ATOMIC_SEQ_CST);
+}
+
+// Атомарно снимает отметку элемента idx в битовой карте.
+static inline void room_bitmap_clear_atomic(uint64_t *bitmap, int count, int idx) {
+    uint64_t *summary = bitmap + ROOM_BITMAP_WORDS(count);
+    uint64_t summary_bit = 1ULL << (idx / 64 % 64);
+
+    if (__atomic_and_fetch(&bitmap[idx / 64], ~(1ULL << (idx % 64)), __ATOMIC_SEQ_CST) == 0) {
+        __atomic_fetch_and(&summary[idx / 4096], ~summary_bit, __ATOMIC_SEQ_CST);
+
+        // Слово могли заполнить между двумя операциями - тогда возвращаем отметку в сводку.
+        if (__atomic_load_n(&bitmap[idx / 64], __ATOMIC_SEQ_CST) != 0) {
+            __atomic_fetch_or(&summary[idx / 4096], summary_bit, __ATOMIC_SEQ_CST);
+        }
+    }
+}
+
+// Возвращает индекс первого отмеченного элемента, начиная с from, или -1, если таких нет.
+static inline int room_bitmap_find_next_atomic(const uint64_t *bitmap, int count, int from) {
+    const uint64_t *summary = bitmap + ROOM_BITMAP_WORDS(count);
+    int summary_words = ROOM_BITMAP_SIZE(count) - ROOM_BITMAP_WORDS(count);
+
+    for (int i = from / 4096; i < summary_words && from < count; ++i) {
+        uint64_t summary_word = __atomic_load_n(&summary[i], __ATOMIC_SEQ_CST);
+
+        // Отбрасываем слова, целиком лежащие до from.
+        if (i == from / 4096) {
+            summary_word &= ~0ULL << (from / 64 % 64);
+        }
+
+        while (summary_word != 0) {
+            int word = i * 64 + __builtin_ctzll(summary_word);
+            uint64_t bits = __atomic_load_n(&bitmap[word], __ATOMIC_SEQ_CST);
+
+            if (word == from / 64) {
+                bits &= ~0ULL << (from % 64);
+            }
+
+            if (bits != 0) {
+                return word * 64 + __builtin_ctzll(bits);
+            }
+
+            summary_word &= summary_word - 1;
+        }
+    }
+
+    return -1;
+}
+
+// Снимает отметку слова word в битовой карте статуса status и возвращает ее, если в слове есть номера с этим статусом.
+static inline void rooms_bitmap_repair_atomic(const rooms_view_t *view, int is_double, int word, room_status status) {
+    uint64_t *bitmap = rooms_status_bitmap(view, is_double, status);
+    uint64_t *packed = is_double ? view->double_rooms : view->single_rooms;
+    int words = ROOM_PACKED_WORDS(is_double ? view->double_rooms_count : view->single_rooms_count);
+
+    if (bitmap == NULL) {
+        return;
+    }
+
+    room_bitmap_clear_atomic(bitmap, words, word);
+
+    if (room_status_mask(__atomic_load_n(&packed[word], __ATOMIC_SEQ_CST), status) != 0) {
+        room_bitmap_set_atomic(bitmap, words, word);
+    }
+}
+
+// Возвращает первый номер с указанным статусом, начиная с from, или -1, если таких нет.
+static inline int rooms_find_next_atomic(const rooms_view_t *view, int is_double, room_status status, int from) {
+    uint64_t *bitmap = rooms_status_bitmap(view, is_double, status);
+    uint64_t *packed = is_double ? view->double_rooms : view->single_rooms;
+    int words = ROOM_PACKED_WORDS(is_double ? view->double_rooms_count : view->single_rooms_count);
+    int word = room_bitmap_find_next_atomic(bitmap, words, from / 32);
+
+    while (word >= 0) {
+        uint64_t mask = room_status_mask(__atomic_load_n(&packed[word], __ATOMIC_SEQ_CST), status);
+        uint64_t wanted = word == from / 32 ? mask & (~0ULL << (from % 32 * 2)) : mask;
+
+        if (wanted != 0) {
+            return word * 32 + __builtin_ctzll(wanted) / 2;
+        } else if (mask == 0) {
+            rooms_bitmap_repair_atomic(view, is_double, word, status);
+        }
+
+        word = room_bitmap_find_next_atomic(bitmap, words, word + 1);
+    }
+
+    return -1;
+}
+
+// Переводит номер из статуса expected в desired одной операцией CAS над словом упакованных статусов
+// и обновляет подсказки в битовых картах. Возвращает 0, если статус номера уже был другим.
+static inline int rooms_transition_cas(const rooms_view_t *view, int is_double, int idx,
+                                       room_status expected, room_status desired) {
+    uint64_t *word = &(is_double ? view->double_rooms : view->single_rooms)[idx / 32];
+    int words = ROOM_PACKED_WORDS(is_double ? view->double_rooms_count : view->single_rooms_count);
+    uint64_t *new_bitmap = rooms_status_bitmap(view, is_double, desired);
+    int shift = idx % 32 * 2;
+    uint64_t current = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+    uint64_t next;
+
+    // CAS повторяется, если менялись соседние номера того же слова, а наш номер сохранил ожидаемый статус.
+    do {
+        if ((room_status) (current >> shift & 3) != expected) {
+            rooms_bitmap_repair_atomic(view, is_double, idx / 32, expected);
+            return 0;
+        }
+
+        next = (current & ~(3ULL << shift)) | ((uint64_t) desired << shift);
+    } while (!__atomic_compare_exchange_n(word, &current, next, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+
+    rooms_vacancy_update(view, is_double, expected, desired);
+
+    if (new_bitmap != NULL) {
+        room_bitmap_set_atomic(new_bitmap, words, idx / 32);
+    }
+
+    if (room_status_mask(next, expected) == 0) {
+        rooms_bitmap_repair_atomic(view, is_double, idx / 32, expected);
+    }
+
+    return 1;
+}
+
+// Бронирует свободный одноместный номер без блокировок. Возвращает его индекс или -1.
+static inline int rooms_book_single_cas(const rooms_view_t *view) {
+    if (rooms_vacancy_get(view, 0, freed) == 0) {
+        return -1;
+    }
+
+    int idx = rooms_find_next_atomic(view, 0, freed, 0);
+
+    while (idx >= 0 && !rooms_transition_cas(view, 0, idx, freed, full)) {
+        idx = rooms_find_next_atomic(view, 0, freed, idx + 1);
+    }
+
+    return idx;
+}
+
+// Бронирует двухместный номер без блокировок, правила выбора те же, что и у rooms_book_double.
+static inline int rooms_book_double_cas(const rooms_view_t *view, int gender, room_status *previous) {
+    room_status busied = gender == 0 ? busied_by_man : busied_by_woman;
+    int free_idx = rooms_vacancy_get(view, 1, freed) > 0 ? rooms_find_next_atomic(view, 1, freed, 0) : -1;
+    int half_idx = rooms_vacancy_get(view, 1, busied) > 0 ? rooms_find_next_atomic(view, 1, busied, 0) : -1;
+
+    while (free_idx >= 0 || half_idx >= 0) {
+        if (half_idx >= 0 && (free_idx == -1 || half_idx < free_idx)) {
+            if (rooms_transition_cas(view, 1, half_idx, busied, full)) {
+                *previous = busied;
+                return half_idx;
+            }
+
+            half_idx = rooms_find_next_atomic(view, 1, busied, half_idx + 1);
+        } else {
+            if (rooms_transition_cas(view, 1, free_idx, freed, busied)) {
+                *previous = freed;
+                return free_idx;
+            }
+
+            free_idx = rooms_find_next_atomic(view, 1, freed, free_idx + 1);
+        }
+    }
+
+    return -1;
+}
+
+// Освобождает одноместный номер без блокировок.
+static inline void rooms_release_single_cas(const rooms_view_t *view, int idx) {
+    rooms_transition_cas(view, 0, idx, full, freed);
+}
+
+// Освобождает место в двухместном номере без блокировок.
+// Соседа могут заселить или выселить одновременно с нами, поэтому при неудаче CAS статус перечитывается.
+static inline void rooms_release_double_cas(const rooms_view_t *view, int idx, int gender) {
+    while (1) {
+        uint64_t word = __atomic_load_n(&view->double_rooms[idx / 32], __ATOMIC_SEQ_CST);
+        room_status status = (room_status) (word >> (idx % 32 * 2) & 3);
+
+        if (status == full) {
+            if (rooms_transition_cas(view, 1, idx, full, gender == 0 ? busied_by_man : busied_by_woman)) {
+                return;
+            }
+        } else if (status == busied_by_man || status == busied_by_woman) {
+            if (rooms_transition_cas(view, 1, idx, status, freed)) {
+                return;
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+#endif //HW2_COMMON_ROOMS_H
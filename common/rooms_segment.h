@@ -0,0 +1,887 @@
+#ifndef HW2_COMMON_ROOMS_SEGMENT_H
+#define HW2_COMMON_ROOMS_SEGMENT_H
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache_line.h"
+#include "event_log.h"
+#include "rooms.h"
+#include "shm_lock.h"
+#include "stats.h"
+#include "sysv_lock.h"
+
+#define ROOMS_SEGMENT_MAGIC 0x4c45544fu
+#define ROOMS_SEGMENT_VERSION 11
+#define DEFAULT_SINGLE_ROOMS_COUNT 10
+#define DEFAULT_DOUBLE_ROOMS_COUNT 15
+// Наибольшее число шардов, на которые делятся номера отеля.
+#define ROOMS_MAX_SHARDS 1024
+// Наибольшее число мест в листе ожидания.
+#define ROOMS_MAX_WAITLIST 65536
+// Наибольшее число номеров каждого типа: размеры массивов номеров и их сквозная нумерация считаются в int.
+#define ROOMS_MAX_COUNT (1 << 30)
+// Наибольшее число мест в очереди выездов.
+#define ROOMS_MAX_CHECKOUTS 65536
+// Наибольшее число потоков в пуле, обслуживающем клиентов.
+#define ROOMS_MAX_WORKER_THREADS 1024
+
+// Блокировки шардов в режиме booking_with_lock.
+typedef enum {
+    // Блокировка не задана аргументом lock=: программа отеля выбирает свою, в сегменте это rooms_lock_futex.
+    rooms_lock_default,
+    // Блокировка на futex в описании шарда (common/shm_lock.h).
+    rooms_lock_futex,
+    // Набор семафоров System V с флагом SEM_UNDO, по семафору на шард (common/sysv_lock.h).
+    rooms_lock_sysv,
+    // Именованные семафоры POSIX, по семафору на шард. Их открывает отель, а процессы клиентов получают открытыми
+    // через fork.
+    rooms_lock_posix
+} rooms_lock_kind;
+
+// Именованные семафоры шардов rooms_lock_posix. Указатели на sem_t действуют только в процессе, который открыл
+// семафоры, и в его потомках, поэтому таблица лежит не в сегменте, а в памяти процесса.
+static sem_t **rooms_posix_locks;
+
+// Шард - независимая часть номеров отеля со своей блокировкой, своими массивами статусов и битовыми картами.
+// Клиенты, которые бронируют номера в разных шардах, не ждут друг друга.
+typedef struct {
+    // Блокировка номеров шарда в режиме booking_with_lock. Ее слово меняет каждый захват, поэтому она занимает
+    // отдельную кеш-линию и не вытесняет у других процессов описание шарда и блокировки соседних шардов.
+    CACHE_LINE_ALIGNED shm_lock_t lock;
+    // Число номеров шарда каждого статуса. Под блокировкой счетчики меняются вместе с ее словом, поэтому лежат в той
+    // же кеш-линии.
+    rooms_vacancy_t vacancy;
+    // Номера шарда занимают в сквозной нумерации отеля отрезки, начинающиеся с first_single_room и first_double_room.
+    // Остальные поля после разметки только читаются.
+    CACHE_LINE_ALIGNED int32_t first_single_room;
+    int32_t single_rooms_count;
+    int32_t first_double_room;
+    int32_t double_rooms_count;
+    // Смещения массивов шарда от начала заголовка сегмента.
+    uint64_t single_rooms_offset;
+    uint64_t double_rooms_offset;
+    uint64_t free_single_rooms_offset;
+    uint64_t free_double_rooms_offset;
+    uint64_t man_double_rooms_offset;
+    uint64_t woman_double_rooms_offset;
+} rooms_shard_t;
+
+// Заголовок самоописывающего сегмента с состоянием комнат.
+// Сразу за ним в той же памяти лежат описания шардов, а за ними - упакованные статусы номеров (по 2 бита на номер) и
+// битовые карты каждого шарда, а в конце - лист ожидания, очередь выездов и кольцо журнала, если они включены. Смещения отсчитываются
+// от начала заголовка.
+// Клиенты узнают размеры отеля только из заголовка, поэтому отель можно запускать с любым числом номеров.
+// Первая кеш-линия заголовка после разметки только читается. Счетчики, описания шардов и номера каждого шарда
+// начинаются с новой кеш-линии, так что запись в них не задевает чужие данные.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    // Полный размер сегмента вместе с заголовком.
+    uint64_t size;
+    int32_t single_rooms_count;
+    int32_t double_rooms_count;
+    int32_t booking_mode;
+    int32_t shards_count;
+    // Чем защищены шарды и, для rooms_lock_sysv, идентификатор набора семафоров.
+    int32_t lock_kind;
+    int32_t lock_sem_id;
+    uint64_t shards_offset;
+    // Смещение листа ожидания или 0, если он выключен.
+    uint64_t waitlist_offset;
+    // Смещение очереди выездов или 0, если клиенты освобождают номера сами.
+    uint64_t checkouts_offset;
+    // Смещение кольца журнала или 0, если журнал выключен.
+    uint64_t log_offset;
+    // Счетчики работы отеля, которые пополняют клиенты, по полосе на группу писателей.
+    hotel_stats_stripes_t stats;
+} rooms_header_t;
+
+// Параметры отеля, заданные при запуске.
+typedef struct {
+    int single_rooms_count;
+    int double_rooms_count;
+    booking_mode booking_mode;
+    // Число шардов, на которые делятся номера.
+    int shards_count;
+    // Блокировка шардов, заданная аргументом lock=.
+    rooms_lock_kind lock_kind;
+    // Число мест в листе ожидания (0 - клиенты, которым не хватило номера, сразу уходят).
+    int waitlist_capacity;
+    // Освобождает ли номера по окончании аренды поток выездов отеля (иначе - сами клиенты).
+    int hotel_checkouts;
+    // Уровень журнала событий клиентов.
+    log_level log_level;
+    // Сколько записей должно помещаться в кольцо журнала (0 - EVENT_LOG_DEFAULT_CAPACITY).
+    int log_capacity;
+    // Печатать ли в журнале момент каждого события.
+    int log_time;
+    // Число потоков, обслуживающих клиентов внутри одного процесса (0 - процесс на каждого клиента).
+    int worker_threads;
+    // Файл с трассой клиентов для программ на 4-6 баллов.
+    const char *clients_path;
+    // Файл журнала заселений демона на 9-10 баллов или NULL, если журнал не ведется.
+    const char *journal_path;
+} rooms_config_t;
+
+// Бронирование номера в сегменте.
+typedef struct {
+    int shard;
+    int is_double;
+    // Индекс номера внутри шарда.
+    int idx;
+    // Статус двухместного номера до заселения: freed или номер с соседом того же пола.
+    room_status previous_status;
+} rooms_booking_t;
+
+// Состояние места в листе ожидания. Поле state - слово futex, на котором спит ожидающий клиент.
+typedef enum {
+    waiter_free,
+    waiter_waiting,
+    // Номер забронирован для клиента, бронирование лежит в месте.
+    waiter_granted,
+    // Отель закрылся, не дождавшись свободного номера.
+    waiter_closed
+} waiter_state;
+
+// Место в листе ожидания. Каждый клиент спит на своем слове в отдельной кеш-линии, и отель будит ровно его.
+typedef struct CACHE_LINE_ALIGNED {
+    uint32_t state;
+    // Поток клиента: места завершившихся клиентов освобождаются, а не получают номер.
+    uint32_t tid;
+    int32_t client_id;
+    int32_t gender;
+    rooms_booking_t booking;
+} rooms_waiter_t;
+
+// Лист ожидания - ограниченная очередь клиентов, которым не хватило номера. Места выдаются по порядку от head до
+// tail, освободившийся номер достается первому клиенту, которому он подходит. Места за head, которые уже
+// освободились, переиспользуются, только когда head до них дойдет.
+typedef struct CACHE_LINE_ALIGNED {
+    shm_lock_t lock;
+    uint64_t head;
+    uint64_t tail;
+    // Число ожидающих клиентов. Читается без блокировки: пока оно ноль, освобождающие номер клиенты не трогают лист.
+    uint32_t waiting_count;
+    uint32_t closed;
+    uint32_t capacity;
+} rooms_waitlist_t;
+
+// Выезд, который клиент поручает потоку выездов отеля: клиент не ждет окончания аренды сам.
+typedef struct {
+    // Момент окончания аренды по монотонным часам (stats_now_ns).
+    uint64_t expires_at;
+    int32_t client_id;
+    int32_t gender;
+    rooms_booking_t booking;
+} rooms_checkout_t;
+
+// Место очереди выездов. Как и в кольце журнала, sequence равен позиции, когда место свободно для записи с этой
+// позиции, и позиции + 1, когда выезд записан.
+typedef struct {
+    uint64_t sequence;
+    rooms_checkout_t checkout;
+} rooms_checkout_slot_t;
+
+// Очередь выездов - ограниченная очередь от многих клиентов к одному потоку выездов отеля. Клиенты занимают позиции
+// CAS-ом по tail, поток забирает выезды по порядку и сам планирует их по времени. Места лежат сразу за очередью.
+typedef struct CACHE_LINE_ALIGNED {
+    uint64_t tail;
+    // Слово futex, на котором спит поток выездов: клиенты увеличивают его после каждой записи.
+    uint32_t pushed;
+    // Поток выездов собирается заснуть или спит: только тогда клиенту нужен системный вызов, чтобы его разбудить.
+    uint32_t consumer_sleeping;
+    uint32_t capacity;
+    // Позиция следующего выезда для потока. Меняет только он, поэтому она лежит в отдельной кеш-линии.
+    CACHE_LINE_ALIGNED uint64_t head;
+    // Слово futex, на котором спят клиенты, если очередь заполнена: поток увеличивает его, забрав выезд.
+    uint32_t popped;
+    uint32_t producers_waiting;
+} rooms_checkouts_t;
+
+// Размечает массивы шарда начиная со смещения offset и возвращает смещение, следующее за ними.
+static inline uint64_t rooms_shard_layout(rooms_shard_t *shard, uint64_t offset) {
+    shard->single_rooms_offset = offset;
+    offset += sizeof(uint64_t) * ROOM_PACKED_WORDS(shard->single_rooms_count);
+    shard->double_rooms_offset = offset;
+    offset += sizeof(uint64_t) * ROOM_PACKED_WORDS(shard->double_rooms_count);
+    shard->free_single_rooms_offset = offset;
+    offset += sizeof(uint64_t) * ROOM_BITMAP_SIZE(ROOM_PACKED_WORDS(shard->single_rooms_count));
+    shard->free_double_rooms_offset = offset;
+    offset += sizeof(uint64_t) * ROOM_BITMAP_SIZE(ROOM_PACKED_WORDS(shard->double_rooms_count));
+    shard->man_double_rooms_offset = offset;
+    offset += sizeof(uint64_t) * ROOM_BITMAP_SIZE(ROOM_PACKED_WORDS(shard->double_rooms_count));
+    shard->woman_double_rooms_offset = offset;
+    offset += sizeof(uint64_t) * ROOM_BITMAP_SIZE(ROOM_PACKED_WORDS(shard->double_rooms_count));
+    return offset;
+}
+
+// Возвращает число записей кольца журнала для конфигурации отеля.
+static inline uint32_t rooms_config_log_capacity(const rooms_config_t *config) {
+    return event_log_capacity(config->log_capacity > 0 ? (uint64_t) config->log_capacity : EVENT_LOG_DEFAULT_CAPACITY);
+}
+
+// Возвращает число мест очереди выездов: степень двойки, не меньшая числа мест в отеле (выездов, ожидающих потока,
+// не бывает больше, чем занятых мест), но не больше ROOMS_MAX_CHECKOUTS.
+static inline uint32_t rooms_config_checkouts_capacity(const rooms_config_t *config) {
+    int64_t places = (int64_t) config->single_rooms_count + (int64_t) config->double_rooms_count * 2;
+    uint32_t capacity = 16;
+
+    while (capacity < places && capacity < ROOMS_MAX_CHECKOUTS) {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+// Задает размер кольца журнала так, чтобы в него поместились события всех clients_count клиентов, если размер не задан
+// аргументом log_records=N. Так отель, заранее знающий своих клиентов, не теряет ни одной строки журнала и не держит
+// в сегменте лишнего.
+static inline void rooms_config_log_clients(rooms_config_t *config, int clients_count) {
+    if (config->log_capacity == 0) {
+        config->log_capacity = clients_count < EVENT_LOG_MAX_CAPACITY ? clients_count * EVENT_LOG_CLIENT_EVENTS
+                                                                      : EVENT_LOG_MAX_CAPACITY;
+    }
+}
+
+// Размечает сегмент под конфигурацию отеля. Если shards не NULL, в него записываются описания шардов.
+// Номера делятся между шардами поровну, каждый шард получает отрезок сквозной нумерации.
+static inline void rooms_segment_layout(rooms_header_t *header, rooms_shard_t *shards, const rooms_config_t *config) {
+    int single_count = config->single_rooms_count;
+    int double_count = config->double_rooms_count;
+    int shards_count = config->shards_count;
+    int waitlist_capacity = config->waitlist_capacity;
+    shards_count = shards_count < 1 ? 1 : shards_count > ROOMS_MAX_SHARDS ? ROOMS_MAX_SHARDS : shards_count;
+    waitlist_capacity = waitlist_capacity > ROOMS_MAX_WAITLIST ? ROOMS_MAX_WAITLIST : waitlist_capacity;
+
+    memset(header, 0, sizeof(rooms_header_t));
+    header->magic = ROOMS_SEGMENT_MAGIC;
+    header->version = ROOMS_SEGMENT_VERSION;
+    header->single_rooms_count = single_count;
+    header->double_rooms_count = double_count;
+    header->shards_count = shards_count;
+    header->shards_offset = sizeof(rooms_header_t);
+
+    uint64_t offset = header->shards_offset + sizeof(rooms_shard_t) * shards_count;
+    for (int i = 0; i < shards_count; ++i) {
+        // Номера шарда меняются под его блокировкой: чтобы клиенты соседних шардов не писали в одну кеш-линию,
+        // массивы каждого шарда начинаются с новой линии.
+        offset = cache_line_round(offset);
+        rooms_shard_t shard;
+        memset(&shard, 0, sizeof(rooms_shard_t));
+        shard.first_single_room = (int32_t) ((int64_t) single_count * i / shards_count);
+        shard.single_rooms_count = (int32_t) ((int64_t) single_count * (i + 1) / shards_count) - shard.first_single_room;
+        shard.first_double_room = (int32_t) ((int64_t) double_count * i / shards_count);
+        shard.double_rooms_count = (int32_t) ((int64_t) double_count * (i + 1) / shards_count) - shard.first_double_room;
+        offset = rooms_shard_layout(&shard, offset);
+
+        if (shards != NULL) {
+            shards[i] = shard;
+        }
+    }
+
+    offset = cache_line_round(offset);
+    if (waitlist_capacity > 0) {
+        header->waitlist_offset = offset;
+        offset += sizeof(rooms_waitlist_t) + sizeof(rooms_waiter_t) * waitlist_capacity;
+    }
+
+    offset = cache_line_round(offset);
+    if (config->hotel_checkouts) {
+        header->checkouts_offset = offset;
+        offset += sizeof(rooms_checkouts_t) + sizeof(rooms_checkout_slot_t) * rooms_config_checkouts_capacity(config);
+    }
+
+    offset = cache_line_round(offset);
+    if (config->log_level != log_level_off) {
+        header->log_offset = offset;
+        offset += event_log_size(rooms_config_log_capacity(config));
+    }
+
+    header->size = offset;
+}
+
+// Возвращает полный размер сегмента для конфигурации отеля.
+static inline size_t rooms_segment_size(const rooms_config_t *config) {
+    rooms_header_t header;
+    rooms_segment_layout(&header, NULL, config);
+    return header.size;
+}
+
+// Проверяет, что сегмент создан совместимой версией отеля.
+static inline int rooms_segment_is_valid(const rooms_header_t *header) {
+    return header->magic == ROOMS_SEGMENT_MAGIC && header->version == ROOMS_SEGMENT_VERSION;
+}
+
+// Возвращает описание шарда.
+static inline rooms_shard_t *rooms_segment_shard(rooms_header_t *header, int shard) {
+    return (rooms_shard_t *) ((char *) header + header->shards_offset) + shard;
+}
+
+// Строит представление номеров шарда над сегментом, отображенным в адресное пространство текущего процесса.
+static inline rooms_view_t rooms_segment_view(rooms_header_t *header, int shard) {
+    char *base = (char *) header;
+    rooms_shard_t *descriptor = rooms_segment_shard(header, shard);
+    rooms_view_t view = {
+            (uint64_t *) (base + descriptor->single_rooms_offset),
+            (uint64_t *) (base + descriptor->double_rooms_offset),
+            (uint64_t *) (base + descriptor->free_single_rooms_offset),
+            (uint64_t *) (base + descriptor->free_double_rooms_offset),
+            (uint64_t *) (base + descriptor->man_double_rooms_offset),
+            (uint64_t *) (base + descriptor->woman_double_rooms_offset),
+            &descriptor->vacancy,
+            descriptor->single_rooms_count,
+            descriptor->double_rooms_count
+    };
+    return view;
+}
+
+// Возвращает лист ожидания или NULL, если он выключен.
+static inline rooms_waitlist_t *rooms_segment_waitlist(rooms_header_t *header) {
+    return header->waitlist_offset != 0 ? (rooms_waitlist_t *) ((char *) header + header->waitlist_offset) : NULL;
+}
+
+// Возвращает место листа ожидания с порядковым номером position.
+static inline rooms_waiter_t *rooms_waitlist_slot(rooms_waitlist_t *waitlist, uint64_t position) {
+    return (rooms_waiter_t *) (waitlist + 1) + position % waitlist->capacity;
+}
+
+// Возвращает очередь выездов или NULL, если клиенты освобождают номера сами.
+static inline rooms_checkouts_t *rooms_segment_checkouts(rooms_header_t *header) {
+    return header->checkouts_offset != 0 ? (rooms_checkouts_t *) ((char *) header + header->checkouts_offset) : NULL;
+}
+
+// Возвращает место очереди выездов для позиции position.
+static inline rooms_checkout_slot_t *rooms_checkouts_slot(rooms_checkouts_t *checkouts, uint64_t position) {
+    return (rooms_checkout_slot_t *) (checkouts + 1) + (position & (checkouts->capacity - 1));
+}
+
+// Возвращает кольцо журнала или NULL, если журнал выключен.
+static inline event_log_t *rooms_segment_log(rooms_header_t *header) {
+    return header->log_offset != 0 ? (event_log_t *) ((char *) header + header->log_offset) : NULL;
+}
+
+// Размечает сегмент и помечает все номера свободными.
+static inline void rooms_segment_init(rooms_header_t *header, const rooms_config_t *config) {
+    // Описания шардов лежат сразу за заголовком.
+    rooms_segment_layout(header, (rooms_shard_t *) (header + 1), config);
+    uint64_t arrays_offset = header->shards_offset + sizeof(rooms_shard_t) * header->shards_count;
+    memset((char *) header + arrays_offset, 0, header->size - arrays_offset);
+    header->booking_mode = config->booking_mode;
+    header->lock_kind = rooms_lock_futex;
+    header->lock_sem_id = -1;
+
+    for (int i = 0; i < header->shards_count; ++i) {
+        rooms_view_t view = rooms_segment_view(header, i);
+        shm_lock_init(&rooms_segment_shard(header, i)->lock);
+        rooms_init(&view);
+    }
+
+    rooms_waitlist_t *waitlist = rooms_segment_waitlist(header);
+    if (waitlist != NULL) {
+        shm_lock_init(&waitlist->lock);
+        waitlist->capacity = (uint32_t) ((header->size - header->waitlist_offset - sizeof(rooms_waitlist_t)) /
+                                         sizeof(rooms_waiter_t));
+    }
+
+    rooms_checkouts_t *checkouts = rooms_segment_checkouts(header);
+    if (checkouts != NULL) {
+        checkouts->capacity = rooms_config_checkouts_capacity(config);
+        for (uint32_t i = 0; i < checkouts->capacity; ++i) {
+            rooms_checkouts_slot(checkouts, i)->sequence = i;
+        }
+    }
+
+    event_log_t *log = rooms_segment_log(header);
+    if (log != NULL) {
+        event_log_init(log, rooms_config_log_capacity(config), config->log_level, config->log_time);
+    }
+}
+
+// Возвращает полосу счетчиков отеля, которую пополняет текущий поток.
+static inline hotel_stats_t *rooms_segment_stats(rooms_header_t *header) {
+    return stats_stripe(&header->stats, shm_lock_current_tid());
+}
+
+// Защищает шарды набором семафоров System V sem_id, в котором не меньше shards_count семафоров, вместо блокировок на
+// futex. Вызывается создателем сегмента до того, как им начнут пользоваться клиенты.
+static inline void rooms_segment_use_sysv_locks(rooms_header_t *header, int sem_id) {
+    sysv_lock_init_set(sem_id, header->shards_count);
+    header->lock_sem_id = sem_id;
+    header->lock_kind = rooms_lock_sysv;
+}
+
+// Защищает шарды именованными семафорами POSIX locks (по одному на шард) вместо блокировок на futex. Вызывается
+// отелем до запуска клиентов, которые унаследуют семафоры и таблицу через fork или разделят их как потоки.
+static inline void rooms_segment_use_posix_locks(rooms_header_t *header, sem_t **locks) {
+    rooms_posix_locks = locks;
+    header->lock_kind = rooms_lock_posix;
+}
+
+// Захватывает блокировку шарда и возвращает момент захвата. Время ожидания попадает в статистику отеля.
+// Если прежний владелец блокировки на futex завершился, не освободив ее, битовые карты восстанавливаются по статусам
+// номеров. Семафор System V за завершившегося владельца освобождает ядро, но узнать об этом нельзя, поэтому битовые
+// карты остаются как есть. Семафор POSIX завершившийся владелец оставляет захваченным.
+static inline uint64_t rooms_shard_lock(rooms_header_t *header, int shard) {
+    uint64_t wait_started_at = stats_now_ns();
+
+    if (header->lock_kind == rooms_lock_sysv) {
+        sysv_lock_at(header->lock_sem_id, (unsigned short) shard);
+    } else if (header->lock_kind == rooms_lock_posix) {
+        // Сигнал (например, SIGUSR1 в отеле) прерывает ожидание, поэтому оно повторяется.
+        while (sem_wait(rooms_posix_locks[shard]) == -1 && errno == EINTR) {
+        }
+    } else if (shm_lock(&rooms_segment_shard(header, shard)->lock) == SHM_LOCK_OWNER_DIED) {
+        rooms_view_t view = rooms_segment_view(header, shard);
+        rooms_repair(&view);
+    }
+
+    return stats_record(&rooms_segment_stats(header)->lock_wait, wait_started_at);
+}
+
+// Освобождает блокировку шарда, захваченную в момент hold_started_at, и записывает время удержания в статистику.
+static inline void rooms_shard_unlock(rooms_header_t *header, int shard, uint64_t hold_started_at) {
+    if (header->lock_kind == rooms_lock_sysv) {
+        sysv_unlock_at(header->lock_sem_id, (unsigned short) shard);
+    } else if (header->lock_kind == rooms_lock_posix) {
+        sem_post(rooms_posix_locks[shard]);
+    } else {
+        shm_unlock(&rooms_segment_shard(header, shard)->lock);
+    }
+
+    stats_record(&rooms_segment_stats(header)->lock_hold, hold_started_at);
+}
+
+// Возвращает шард, с которого клиент начинает поиск номера. Клиенты распределяются по шардам хешем идентификатора,
+// поэтому одновременно приходящие клиенты обычно берут разные блокировки.
+static inline int rooms_segment_home_shard(const rooms_header_t *header, int client_id) {
+    return (int) (((uint32_t) client_id * 2654435761u >> 16) % (uint32_t) header->shards_count);
+}
+
+// Проверяет по счетчикам шардов, найдется ли в отеле место клиенту указанного пола. Блокировки не захватываются,
+// поэтому ответ может устареть, пока клиент до них доберется.
+static inline int rooms_segment_has_vacancy(rooms_header_t *header, int gender) {
+    for (int i = 0; i < header->shards_count; ++i) {
+        rooms_view_t view = rooms_segment_view(header, i);
+
+        if (rooms_has_vacancy(&view, gender)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Бронирует номер клиенту: сначала одноместный, затем двухместный - пустой или с соседом того же пола.
+// Поиск начинается с шарда клиента, а если там мест нет, переходит к соседним шардам по кругу. Шарды, в которых по
+// счетчикам нет подходящих мест, пропускаются без блокировки, так что в заполненном отеле клиент получает отказ,
+// не захватив ни одной блокировки.
+// Если lock_shards не ноль и номера бронируются под блокировкой, каждый шард блокируется на время поиска в нем,
+// иначе вызывающий сам отвечает за синхронизацию. Возвращает 0 или -1, если свободных мест нет.
+static inline int rooms_segment_book(rooms_header_t *header, int client_id, int gender, int lock_shards,
+                                     rooms_booking_t *booking) {
+    int use_cas = header->booking_mode == booking_with_cas;
+    int home_shard = rooms_segment_home_shard(header, client_id);
+
+    for (int i = 0; i < header->shards_count; ++i) {
+        int shard = (home_shard + i) % header->shards_count;
+        rooms_view_t view = rooms_segment_view(header, shard);
+
+        if (!rooms_has_vacancy(&view, gender)) {
+            continue;
+        }
+
+        uint64_t hold_started_at = lock_shards && !use_cas ? rooms_shard_lock(header, shard) : 0;
+
+        booking->shard = shard;
+        booking->is_double = 0;
+        booking->previous_status = freed;
+        booking->idx = use_cas ? rooms_book_single_cas(&view) : rooms_book_single(&view);
+
+        if (booking->idx == -1) {
+            booking->is_double = 1;
+            booking->idx = use_cas ? rooms_book_double_cas(&view, gender, &booking->previous_status)
+                                   : rooms_book_double(&view, gender, &booking->previous_status);
+        }
+
+        if (lock_shards && !use_cas) {
+            rooms_shard_unlock(header, shard, hold_started_at);
+        }
+
+        if (booking->idx >= 0) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+// Освобождает место, занятое бронированием booking клиентом указанного пола. Синхронизация та же, что и у
+// rooms_segment_book.
+static inline void rooms_segment_release(rooms_header_t *header, const rooms_booking_t *booking, int gender,
+                                         int lock_shards) {
+    int use_cas = header->booking_mode == booking_with_cas;
+    rooms_view_t view = rooms_segment_view(header, booking->shard);
+    uint64_t hold_started_at = lock_shards && !use_cas ? rooms_shard_lock(header, booking->shard) : 0;
+
+    if (booking->is_double && use_cas) {
+        rooms_release_double_cas(&view, booking->idx, gender);
+    } else if (booking->is_double) {
+        rooms_release_double(&view, booking->idx, gender);
+    } else if (use_cas) {
+        rooms_release_single_cas(&view, booking->idx);
+    } else {
+        rooms_release_single(&view, booking->idx);
+    }
+
+    if (lock_shards && !use_cas) {
+        rooms_shard_unlock(header, booking->shard, hold_started_at);
+    }
+}
+
+// Раздает освободившиеся номера клиентам из листа ожидания в порядке прихода: каждому ожидающему, начиная с первого,
+// бронируется подходящий номер, и клиент просыпается уже с бронированием. Вызывается под блокировкой листа.
+static inline void rooms_waitlist_admit(rooms_header_t *header, rooms_waitlist_t *waitlist, int lock_shards) {
+    for (uint64_t position = waitlist->head; position < waitlist->tail; ++position) {
+        rooms_waiter_t *waiter = rooms_waitlist_slot(waitlist, position);
+
+        // Мест нет ни для мужчин, ни для женщин - дальше смотреть бесполезно.
+        if (!rooms_segment_has_vacancy(header, 0) && !rooms_segment_has_vacancy(header, 1)) {
+            break;
+        }
+
+        if (__atomic_load_n(&waiter->state, __ATOMIC_ACQUIRE) != waiter_waiting) {
+            continue;
+        }
+
+        if (!shm_lock_owner_alive(waiter->tid)) {
+            __atomic_store_n(&waiter->state, waiter_free, __ATOMIC_RELEASE);
+            __atomic_fetch_sub(&waitlist->waiting_count, 1, __ATOMIC_SEQ_CST);
+        } else if (rooms_segment_book(header, waiter->client_id, waiter->gender, lock_shards, &waiter->booking) == 0) {
+            __atomic_store_n(&waiter->state, waiter_granted, __ATOMIC_RELEASE);
+            __atomic_fetch_sub(&waitlist->waiting_count, 1, __ATOMIC_SEQ_CST);
+            syscall(SYS_futex, &waiter->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+        }
+    }
+
+    // Места в начале очереди, которые клиенты уже покинули, можно отдавать новым клиентам.
+    while (waitlist->head < waitlist->tail &&
+           __atomic_load_n(&rooms_waitlist_slot(waitlist, waitlist->head)->state, __ATOMIC_ACQUIRE) == waiter_free) {
+        waitlist->head++;
+    }
+}
+
+// Бронирует номер клиенту, а если мест нет, ставит его в лист ожидания. Возвращает 0, если номер забронирован,
+// 1, если клиент встал в лист (тогда в waiter записывается его место), и -1, если листа нет, он заполнен или
+// отель закрывается. Пока в листе кто-то есть, новые клиенты не обгоняют его: сначала номера раздаются листу.
+static inline int rooms_waitlist_book(rooms_header_t *header, int client_id, int gender, int lock_shards,
+                                      rooms_booking_t *booking, rooms_waiter_t **waiter) {
+    rooms_waitlist_t *waitlist = rooms_segment_waitlist(header);
+
+    if ((waitlist == NULL || __atomic_load_n(&waitlist->waiting_count, __ATOMIC_SEQ_CST) == 0) &&
+        rooms_segment_book(header, client_id, gender, lock_shards, booking) == 0) {
+        return 0;
+    } else if (waitlist == NULL) {
+        return -1;
+    }
+
+    shm_lock(&waitlist->lock);
+    rooms_waitlist_admit(header, waitlist, lock_shards);
+    int result = -1;
+
+    if (rooms_segment_book(header, client_id, gender, lock_shards, booking) == 0) {
+        result = 0;
+    } else if (!waitlist->closed && waitlist->tail - waitlist->head < waitlist->capacity) {
+        *waiter = rooms_waitlist_slot(waitlist, waitlist->tail++);
+        (*waiter)->tid = shm_lock_current_tid();
+        (*waiter)->client_id = client_id;
+        (*waiter)->gender = gender;
+        __atomic_store_n(&(*waiter)->state, waiter_waiting, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&waitlist->waiting_count, 1, __ATOMIC_SEQ_CST);
+        result = 1;
+
+        // Номер могли освободить между нашей попыткой и увеличением счетчика, не заглянув в лист: раздаем еще раз.
+        rooms_waitlist_admit(header, waitlist, lock_shards);
+    }
+
+    shm_unlock(&waitlist->lock);
+    return result;
+}
+
+// Ждет, пока клиенту в листе ожидания не забронируют номер. Возвращает 0 и бронирование или -1, если отель
+// закрылся раньше. Место в листе после этого освобождается.
+static inline int rooms_waitlist_wait(rooms_waiter_t *waiter, rooms_booking_t *booking) {
+    uint32_t state;
+
+    while ((state = __atomic_load_n(&waiter->state, __ATOMIC_ACQUIRE)) == waiter_waiting) {
+        syscall(SYS_futex, &waiter->state, FUTEX_WAIT, waiter_waiting, NULL, NULL, 0);
+    }
+
+    *booking = waiter->booking;
+    __atomic_store_n(&waiter->state, waiter_free, __ATOMIC_RELEASE);
+    return state == waiter_granted ? 0 : -1;
+}
+
+// Отдает освободившийся номер листу ожидания, если в нем кто-то есть. Вызывается после rooms_segment_release.
+static inline void rooms_waitlist_notify(rooms_header_t *header, int lock_shards) {
+    rooms_waitlist_t *waitlist = rooms_segment_waitlist(header);
+
+    // Освобождение номера должно стать видно раньше, чем мы прочитаем счетчик: клиент, встающий в лист, делает
+    // наоборот, поэтому кто-то из двоих обязательно увидит другого.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (waitlist == NULL || __atomic_load_n(&waitlist->waiting_count, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+
+    shm_lock(&waitlist->lock);
+    rooms_waitlist_admit(header, waitlist, lock_shards);
+    shm_unlock(&waitlist->lock);
+}
+
+// Закрывает лист ожидания при остановке отеля: все ожидающие клиенты просыпаются без номера. Отказ каждого из них
+// записывает в журнал сам отель: клиент может не успеть сделать это до того, как отель выведет журнал и завершится.
+static inline void rooms_waitlist_close(rooms_header_t *header) {
+    rooms_waitlist_t *waitlist = rooms_segment_waitlist(header);
+
+    if (waitlist == NULL) {
+        return;
+    }
+
+    shm_lock(&waitlist->lock);
+    waitlist->closed = 1;
+
+    for (uint64_t position = waitlist->head; position < waitlist->tail; ++position) {
+        rooms_waiter_t *waiter = rooms_waitlist_slot(waitlist, position);
+        uint32_t expected = waiter_waiting;
+
+        if (__atomic_compare_exchange_n(&waiter->state, &expected, waiter_closed, 0, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+            event_log_write(rooms_segment_log(header), log_client_out_of_service, waiter->client_id, 0, 0);
+            __atomic_fetch_sub(&waitlist->waiting_count, 1, __ATOMIC_SEQ_CST);
+            syscall(SYS_futex, &waiter->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+        }
+    }
+
+    shm_unlock(&waitlist->lock);
+}
+
+// Поручает выезд потоку выездов отеля. Если очередь заполнена, ждет, пока поток не заберет из нее выезд.
+static inline void rooms_checkouts_push(rooms_header_t *header, const rooms_checkout_t *checkout) {
+    rooms_checkouts_t *checkouts = rooms_segment_checkouts(header);
+    uint64_t position = __atomic_load_n(&checkouts->tail, __ATOMIC_RELAXED);
+
+    while (1) {
+        rooms_checkout_slot_t *slot = rooms_checkouts_slot(checkouts, position);
+        uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence == position) {
+            if (__atomic_compare_exchange_n(&checkouts->tail, &position, position + 1, 1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                slot->checkout = *checkout;
+                __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+                break;
+            }
+        } else if (sequence < position) {
+            // Место еще занято выездом, записанным на круг раньше: очередь заполнена. Засыпаем, только если поток
+            // не забрал выезд после того, как мы прочитали его счетчик, иначе futex сразу вернет управление.
+            uint32_t popped = __atomic_load_n(&checkouts->popped, __ATOMIC_SEQ_CST);
+            __atomic_fetch_add(&checkouts->producers_waiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&slot->sequence, __ATOMIC_SEQ_CST) == sequence) {
+                syscall(SYS_futex, &checkouts->popped, FUTEX_WAIT, popped, NULL, NULL, 0);
+            }
+            __atomic_fetch_sub(&checkouts->producers_waiting, 1, __ATOMIC_SEQ_CST);
+            position = __atomic_load_n(&checkouts->tail, __ATOMIC_RELAXED);
+        } else {
+            position = __atomic_load_n(&checkouts->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Счетчик увеличивается после записи, а флаг читается после счетчика: поток, собравшийся заснуть, ставит флаг
+    // до чтения счетчика, поэтому либо он увидит новый выезд, либо мы увидим флаг и разбудим его.
+    __atomic_fetch_add(&checkouts->pushed, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&checkouts->consumer_sleeping, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, &checkouts->pushed, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+// Забирает из очереди следующий выезд. Вызывается только потоком выездов. Возвращает 0 или -1, если очередь пуста.
+static inline int rooms_checkouts_pop(rooms_header_t *header, rooms_checkout_t *checkout) {
+    rooms_checkouts_t *checkouts = rooms_segment_checkouts(header);
+    rooms_checkout_slot_t *slot = rooms_checkouts_slot(checkouts, checkouts->head);
+
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != checkouts->head + 1) {
+        return -1;
+    }
+
+    *checkout = slot->checkout;
+    __atomic_store_n(&slot->sequence, checkouts->head + checkouts->capacity, __ATOMIC_SEQ_CST);
+    checkouts->head++;
+
+    __atomic_fetch_add(&checkouts->popped, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&checkouts->producers_waiting, __ATOMIC_SEQ_CST) != 0) {
+        syscall(SYS_futex, &checkouts->popped, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+    }
+
+    return 0;
+}
+
+// Проверяет, пуста ли очередь выездов. Вызывается только потоком выездов.
+static inline int rooms_checkouts_empty(rooms_header_t *header) {
+    rooms_checkouts_t *checkouts = rooms_segment_checkouts(header);
+    rooms_checkout_slot_t *slot = rooms_checkouts_slot(checkouts, checkouts->head);
+    return __atomic_load_n(&slot->sequence, __ATOMIC_SEQ_CST) != checkouts->head + 1;
+}
+
+// Объявляет, что поток выездов собирается заснуть, и возвращает слово futex, которое надо передать в
+// rooms_checkouts_wait. Все, что поток проверит после этого вызова, не потеряет пробуждения: клиент, поручивший
+// выезд позже, увидит флаг и разбудит поток.
+static inline uint32_t rooms_checkouts_prepare_wait(rooms_header_t *header) {
+    rooms_checkouts_t *checkouts = rooms_segment_checkouts(header);
+    __atomic_store_n(&checkouts->consumer_sleeping, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&checkouts->pushed, __ATOMIC_SEQ_CST);
+}
+
+// Усыпляет поток выездов, пока клиент не поручит ему новый выезд, но не дольше timeout_ns (-1 - без ограничения,
+// 0 - не засыпать). Может вернуться и раньше, например, если поток будят, чтобы остановить.
+static inline void rooms_checkouts_wait(rooms_header_t *header, uint32_t pushed, int64_t timeout_ns) {
+    rooms_checkouts_t *checkouts = rooms_segment_checkouts(header);
+    struct timespec timeout = {timeout_ns / 1000000000, timeout_ns % 1000000000};
+
+    if (timeout_ns != 0 && rooms_checkouts_empty(header)) {
+        syscall(SYS_futex, &checkouts->pushed, FUTEX_WAIT, pushed, timeout_ns > 0 ? &timeout : NULL, NULL, 0);
+    }
+
+    __atomic_store_n(&checkouts->consumer_sleeping, 0, __ATOMIC_RELAXED);
+}
+
+// Будит поток выездов, даже если новых выездов нет.
+static inline void rooms_checkouts_wake(rooms_header_t *header) {
+    rooms_checkouts_t *checkouts = rooms_segment_checkouts(header);
+    __atomic_fetch_add(&checkouts->pushed, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &checkouts->pushed, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Возвращает номер комнаты из бронирования в сквозной нумерации отеля.
+static inline int rooms_booking_room(rooms_header_t *header, const rooms_booking_t *booking) {
+    rooms_shard_t *shard = rooms_segment_shard(header, booking->shard);
+    return booking->idx + (booking->is_double ? shard->first_double_room : shard->first_single_room);
+}
+
+// Читает значение параметра name из строки text. Строка должна целиком быть числом от min до max, иначе печатается
+// сообщение и возвращается -1.
+static inline int rooms_config_int(const char *name, const char *text, long min, long max, int *value) {
+    char *end;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+
+    if (errno != 0 || end == text || *end != '\0' || parsed < min || parsed > max) {
+        fprintf(stderr, "invalid %s: %s (expected %ld..%ld)\n", name, text, min, max);
+        return -1;
+    }
+
+    *value = (int) parsed;
+    return 0;
+}
+
+// Читает число номеров из конфигурационного файла со строками вида "single_rooms 1000" и "double_rooms 500".
+// Возвращает -1 и печатает сообщение, если файл не открылся или число номеров в нем некорректно.
+static inline int rooms_config_load(rooms_config_t *config, const char *path) {
+    FILE *file = fopen(path, "r");
+    char key[64];
+    char text[64];
+    int result = 0;
+
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (result == 0 && fscanf(file, "%63s %63s", key, text) == 2) {
+        if (strcmp(key, "single_rooms") == 0) {
+            result = rooms_config_int(key, text, 0, ROOMS_MAX_COUNT, &config->single_rooms_count);
+        } else if (strcmp(key, "double_rooms") == 0) {
+            result = rooms_config_int(key, text, 0, ROOMS_MAX_COUNT, &config->double_rooms_count);
+        }
+    }
+
+    fclose(file);
+    return result;
+}
+
+// Разбирает аргументы запуска отеля: [число_одноместных число_двухместных | файл_конфигурации] [cas] [shards=N]
+// [lock=futex|sysv] [waitlist=N] [log=off|info|debug] [log_records=N] [log_time] [threads=N] [clients=файл] [journal=файл].
+// Возвращает -1, если конфигурацию прочитать не удалось или значение параметра некорректно: сообщение об ошибке уже
+// напечатано.
+static inline int rooms_config_parse(rooms_config_t *config, int argc, char *argv[]) {
+    int counts_read = 0;
+
+    config->single_rooms_count = DEFAULT_SINGLE_ROOMS_COUNT;
+    config->double_rooms_count = DEFAULT_DOUBLE_ROOMS_COUNT;
+    config->booking_mode = booking_with_lock;
+    config->shards_count = 1;
+    config->lock_kind = rooms_lock_default;
+    config->waitlist_capacity = 0;
+    config->hotel_checkouts = 0;
+    config->log_level = log_level_debug;
+    config->log_capacity = 0;
+    config->log_time = 0;
+    config->worker_threads = 0;
+    config->clients_path = "clients.txt";
+    config->journal_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        char *end;
+        strtol(argv[i], &end, 10);
+        // Числа без имени параметра задают число одноместных и двухместных номеров.
+        int is_number = end != argv[i] && *end == '\0';
+        int result = 0;
+
+        if (strcmp(argv[i], "cas") == 0) {
+            config->booking_mode = booking_with_cas;
+        } else if (strncmp(argv[i], "shards=", 7) == 0) {
+            result = rooms_config_int("shards", argv[i] + 7, 1, ROOMS_MAX_SHARDS, &config->shards_count);
+        } else if (strcmp(argv[i], "lock=futex") == 0) {
+            config->lock_kind = rooms_lock_futex;
+        } else if (strcmp(argv[i], "lock=sysv") == 0) {
+            config->lock_kind = rooms_lock_sysv;
+        } else if (strncmp(argv[i], "waitlist=", 9) == 0) {
+            result = rooms_config_int("waitlist", argv[i] + 9, 0, ROOMS_MAX_WAITLIST, &config->waitlist_capacity);
+        } else if (strcmp(argv[i], "log=off") == 0) {
+            config->log_level = log_level_off;
+        } else if (strcmp(argv[i], "log=info") == 0) {
+            config->log_level = log_level_info;
+        } else if (strcmp(argv[i], "log=debug") == 0) {
+            config->log_level = log_level_debug;
+        } else if (strncmp(argv[i], "log_records=", 12) == 0) {
+            result = rooms_config_int("log_records", argv[i] + 12, 0, EVENT_LOG_MAX_CAPACITY, &config->log_capacity);
+        } else if (strcmp(argv[i], "log_time") == 0) {
+            config->log_time = 1;
+        } else if (strncmp(argv[i], "threads=", 8) == 0) {
+            result = rooms_config_int("threads", argv[i] + 8, 0, ROOMS_MAX_WORKER_THREADS, &config->worker_threads);
+        } else if (strncmp(argv[i], "clients=", 8) == 0) {
+            config->clients_path = argv[i] + 8;
+        } else if (strncmp(argv[i], "journal=", 8) == 0) {
+            config->journal_path = argv[i] + 8;
+        } else if (is_number && counts_read == 0) {
+            result = rooms_config_int("single rooms count", argv[i], 0, ROOMS_MAX_COUNT, &config->single_rooms_count);
+            counts_read++;
+        } else if (is_number && counts_read == 1) {
+            result = rooms_config_int("double rooms count", argv[i], 0, ROOMS_MAX_COUNT, &config->double_rooms_count);
+            counts_read++;
+        } else {
+            result = rooms_config_load(config, argv[i]);
+        }
+
+        if (result == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#endif //HW2_COMMON_ROOMS_SEGMENT_H
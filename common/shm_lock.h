@@ -0,0 +1,152 @@
+#ifndef HW2_COMMON_SHM_LOCK_H
+#define HW2_COMMON_SHM_LOCK_H
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Наибольшее число попыток захвата в цикле перед засыпанием в ядре.
+#define SHM_LOCK_MAX_SPINS 1000
+// Сколько ожидающий спит в ядре, прежде чем проверить, жив ли владелец блокировки.
+#define SHM_LOCK_OWNER_CHECK_NS 50000000
+// Результат shm_lock: блокировка захвачена у завершившегося владельца, защищаемые ей данные могли остаться
+// недописанными.
+#define SHM_LOCK_OWNER_DIED 1
+
+// Блокировка на futex, которая лежит прямо в разделяемой памяти.
+// Слово блокировки хранит идентификатор потока-владельца (0 - свободна). Захват и освобождение без конкуренции -
+// атомарные операции без системного вызова, в ядро уходят только ожидание и пробуждение.
+typedef struct {
+    uint32_t word;
+    // Число потоков, которые ждут блокировку в ядре или собираются заснуть. Пока оно не ноль, каждое освобождение
+    // будит одного из них. Одного бита "есть ожидающие" в слове не хватает: поток, захвативший блокировку без
+    // ожидания, стирает его, и спящие просыпаются по одному, проигрывая гонку новым клиентам.
+    uint32_t waiters;
+    // Сколько попыток захвата в цикле в среднем требовалось раньше, по нему подбирается длина следующего цикла.
+    int32_t spins;
+    // Сколько раз блокировку пришлось забрать у завершившегося владельца.
+    uint32_t recoveries;
+} shm_lock_t;
+
+// Идентификатор текущего потока. gettid - системный вызов, поэтому он запоминается, а после fork сбрасывается.
+static __thread uint32_t shm_lock_tid;
+static pthread_once_t shm_lock_once = PTHREAD_ONCE_INIT;
+
+static inline void shm_lock_forget_tid() {
+    shm_lock_tid = 0;
+}
+
+static inline void shm_lock_register_atfork() {
+    pthread_atfork(NULL, NULL, shm_lock_forget_tid);
+}
+
+static inline uint32_t shm_lock_current_tid() {
+    if (shm_lock_tid == 0) {
+        pthread_once(&shm_lock_once, shm_lock_register_atfork);
+        shm_lock_tid = (uint32_t) syscall(SYS_gettid);
+    }
+
+    return shm_lock_tid;
+}
+
+// Подсказывает процессору, что поток крутится в цикле ожидания.
+static inline void shm_lock_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#else
+    __asm__ volatile("" ::: "memory");
+#endif
+}
+
+// Проверяет, существует ли еще поток с идентификатором tid.
+// Если идентификатор успели отдать новому процессу, владелец будет считаться живым, и блокировку никто не заберет.
+static inline int shm_lock_owner_alive(uint32_t tid) {
+    return kill((pid_t) tid, 0) == 0 || errno != ESRCH;
+}
+
+// Делает блокировку свободной. Вызывается создателем сегмента до того, как им начнут пользоваться другие процессы.
+static inline void shm_lock_init(shm_lock_t *lock) {
+    lock->word = 0;
+    lock->waiters = 0;
+    lock->spins = 0;
+    lock->recoveries = 0;
+}
+
+// Захватывает блокировку. Сначала блокировка несколько раз проверяется в цикле (владелец обычно держит ее
+// микросекунды), и только потом поток засыпает в ядре. Спящий поток периодически проверяет, жив ли владелец, и
+// забирает блокировку у завершившегося процесса. Возвращает 0 или SHM_LOCK_OWNER_DIED.
+static inline int shm_lock(shm_lock_t *lock) {
+    uint32_t tid = shm_lock_current_tid();
+    uint32_t expected = 0;
+
+    if (__atomic_compare_exchange_n(&lock->word, &expected, tid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    // Длина цикла подстраивается под среднее число попыток, после которого блокировка освобождалась раньше. Если
+    // приходилось засыпать, цикл укорачивается: на одном ядре владелец не может освободить блокировку, пока мы крутимся.
+    int spins = __atomic_load_n(&lock->spins, __ATOMIC_RELAXED);
+    int max_spins = spins * 2 + 10 < SHM_LOCK_MAX_SPINS ? spins * 2 + 10 : SHM_LOCK_MAX_SPINS;
+
+    for (int i = 0; i < max_spins; ++i) {
+        expected = __atomic_load_n(&lock->word, __ATOMIC_RELAXED);
+
+        if (expected == 0 &&
+            __atomic_compare_exchange_n(&lock->word, &expected, tid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&lock->spins, spins + (i - spins) / 8, __ATOMIC_RELAXED);
+            return 0;
+        }
+
+        shm_lock_cpu_relax();
+    }
+
+    __atomic_store_n(&lock->spins, spins - spins / 8, __ATOMIC_RELAXED);
+
+    // Засыпаем в ядре. Счетчик ожидающих увеличивается до проверки слова: освобождающий поток либо увидит его,
+    // либо освободит блокировку раньше, и тогда futex не уснет, потому что слово уже изменилось.
+    struct timespec timeout = {0, SHM_LOCK_OWNER_CHECK_NS};
+    int result = 0;
+    __atomic_fetch_add(&lock->waiters, 1, __ATOMIC_SEQ_CST);
+
+    while (1) {
+        expected = __atomic_load_n(&lock->word, __ATOMIC_SEQ_CST);
+
+        if (expected == 0) {
+            if (__atomic_compare_exchange_n(&lock->word, &expected, tid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                break;
+            }
+
+            continue;
+        }
+
+        // Сегмент разделяют разные процессы, поэтому FUTEX_PRIVATE_FLAG не используется.
+        if (syscall(SYS_futex, &lock->word, FUTEX_WAIT, expected, &timeout, NULL, 0) == -1 && errno == ETIMEDOUT &&
+            !shm_lock_owner_alive(expected) &&
+            __atomic_compare_exchange_n(&lock->word, &expected, tid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_fetch_add(&lock->recoveries, 1, __ATOMIC_RELAXED);
+            result = SHM_LOCK_OWNER_DIED;
+            break;
+        }
+    }
+
+    __atomic_fetch_sub(&lock->waiters, 1, __ATOMIC_RELAXED);
+    return result;
+}
+
+// Освобождает блокировку и будит один ожидающий поток, если такие есть.
+static inline void shm_unlock(shm_lock_t *lock) {
+    __atomic_exchange_n(&lock->word, 0, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&lock->waiters, __ATOMIC_SEQ_CST) != 0) {
+        syscall(SYS_futex, &lock->word, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+#endif //HW2_COMMON_SHM_LOCK_H
@@ -0,0 +1,164 @@
+#ifndef HW2_COMMON_STATS_H
+#define HW2_COMMON_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache_line.h"
+
+// Число корзин гистограммы: корзина i хранит длительности от 2^i до 2^(i+1) наносекунд, последняя - все остальные.
+#define STATS_BUCKETS_COUNT 40
+// Число полос счетчиков в общей памяти. Писатели распределяются по полосам, чтобы не делить одни кеш-линии.
+#define STATS_STRIPES_COUNT 16
+
+// Гистограмма длительностей с корзинами по степеням двойки.
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STATS_BUCKETS_COUNT];
+} stats_histogram_t;
+
+// Счетчики работы отеля в общей памяти. Их пополняют все процессы атомарными операциями,
+// а печатает отель по сигналу SIGUSR1.
+typedef struct CACHE_LINE_ALIGNED {
+    uint64_t booked;
+    // Клиенты, которым не хватило номера ("out of service").
+    uint64_t rejected;
+    uint64_t released;
+    // Клиенты, вставшие в лист ожидания, и сколько они в нем провели.
+    uint64_t waitlisted;
+    stats_histogram_t waitlist_wait;
+    // Ожидание семафора номеров и время его удержания.
+    stats_histogram_t lock_wait;
+    stats_histogram_t lock_hold;
+    // Полный обмен запрос-ответ с отелем по каналам.
+    stats_histogram_t round_trip;
+} hotel_stats_t;
+
+// Счетчики отеля, разбитые на полосы. Каждый писатель пополняет полосу, выбранную по своему идентификатору, и полосы
+// лежат на разных кеш-линиях, поэтому одновременно работающие клиенты не отбирают друг у друга одну и ту же линию.
+// Отель складывает полосы только при печати.
+typedef struct {
+    hotel_stats_t stripes[STATS_STRIPES_COUNT];
+} hotel_stats_stripes_t;
+
+// Возвращает текущее время монотонных часов в наносекундах. В Linux clock_gettime выполняется через vDSO без
+// системного вызова, а в отличие от rdtsc показания согласованы между процессами на разных ядрах.
+static inline uint64_t stats_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+// Увеличивает счетчик.
+static inline void stats_count(uint64_t *counter) {
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+// Добавляет в гистограмму длительность, прошедшую с момента started_at, и возвращает текущее время.
+static inline uint64_t stats_record(stats_histogram_t *histogram, uint64_t started_at) {
+    uint64_t now = stats_now_ns();
+    uint64_t duration = now - started_at;
+    int bucket = duration > 0 ? 63 - __builtin_clzll(duration) : 0;
+    uint64_t max_ns = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->total_ns, duration, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->buckets[bucket < STATS_BUCKETS_COUNT ? bucket : STATS_BUCKETS_COUNT - 1], 1,
+                       __ATOMIC_RELAXED);
+
+    while (duration > max_ns && !__atomic_compare_exchange_n(&histogram->max_ns, &max_ns, duration, 1,
+                                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    return now;
+}
+
+// Возвращает полосу счетчиков писателя writer (идентификатора процесса или потока).
+static inline hotel_stats_t *stats_stripe(hotel_stats_stripes_t *stats, uint32_t writer) {
+    return &stats->stripes[writer % STATS_STRIPES_COUNT];
+}
+
+// Прибавляет гистограмму source к гистограмме total.
+static inline void stats_add_histogram(stats_histogram_t *total, const stats_histogram_t *source) {
+    total->count += __atomic_load_n(&source->count, __ATOMIC_RELAXED);
+    total->total_ns += __atomic_load_n(&source->total_ns, __ATOMIC_RELAXED);
+
+    uint64_t max_ns = __atomic_load_n(&source->max_ns, __ATOMIC_RELAXED);
+    total->max_ns = max_ns > total->max_ns ? max_ns : total->max_ns;
+
+    for (int i = 0; i < STATS_BUCKETS_COUNT; ++i) {
+        total->buckets[i] += __atomic_load_n(&source->buckets[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Складывает все полосы счетчиков в total. Клиенты могут продолжать писать: сумма получится на какой-то момент
+// между началом и концом сложения.
+static inline void stats_sum(const hotel_stats_stripes_t *stats, hotel_stats_t *total) {
+    memset(total, 0, sizeof(hotel_stats_t));
+
+    for (int i = 0; i < STATS_STRIPES_COUNT; ++i) {
+        const hotel_stats_t *stripe = &stats->stripes[i];
+        total->booked += __atomic_load_n(&stripe->booked, __ATOMIC_RELAXED);
+        total->rejected += __atomic_load_n(&stripe->rejected, __ATOMIC_RELAXED);
+        total->released += __atomic_load_n(&stripe->released, __ATOMIC_RELAXED);
+        total->waitlisted += __atomic_load_n(&stripe->waitlisted, __ATOMIC_RELAXED);
+        stats_add_histogram(&total->waitlist_wait, &stripe->waitlist_wait);
+        stats_add_histogram(&total->lock_wait, &stripe->lock_wait);
+        stats_add_histogram(&total->lock_hold, &stripe->lock_hold);
+        stats_add_histogram(&total->round_trip, &stripe->round_trip);
+    }
+}
+
+// Возвращает верхнюю границу корзины, в которую попадает доля fraction всех длительностей.
+static inline double stats_percentile_us(const stats_histogram_t *histogram, double fraction) {
+    uint64_t target = (uint64_t) (fraction * (double) histogram->count);
+    uint64_t seen = 0;
+
+    for (int i = 0; i < STATS_BUCKETS_COUNT; ++i) {
+        seen += histogram->buckets[i];
+        if (seen > target) {
+            return (double) (2ull << i) / 1e3;
+        }
+    }
+
+    return (double) histogram->max_ns / 1e3;
+}
+
+// Печатает сводку по гистограмме, если в нее что-нибудь попало.
+static inline void stats_print_histogram(FILE *file, const char *name, const stats_histogram_t *histogram) {
+    if (histogram->count == 0) {
+        return;
+    }
+
+    fprintf(file, "[STATS] %s: count = %llu, mean = %.1f us, p50 < %.1f us, p99 < %.1f us, p999 < %.1f us, "
+                  "max = %.1f us.\n", name,
+            (unsigned long long) histogram->count, (double) histogram->total_ns / (double) histogram->count / 1e3,
+            stats_percentile_us(histogram, 0.5), stats_percentile_us(histogram, 0.99),
+            stats_percentile_us(histogram, 0.999), (double) histogram->max_ns / 1e3);
+}
+
+// Печатает все счетчики отеля.
+static inline void stats_print(FILE *file, const hotel_stats_t *stats) {
+    fprintf(file, "[STATS] booked = %llu, rejected = %llu, released = %llu.\n", (unsigned long long) stats->booked,
+            (unsigned long long) stats->rejected, (unsigned long long) stats->released);
+    if (stats->waitlisted != 0) {
+        fprintf(file, "[STATS] waitlisted = %llu.\n", (unsigned long long) stats->waitlisted);
+    }
+    stats_print_histogram(file, "waitlist wait", &stats->waitlist_wait);
+    stats_print_histogram(file, "lock wait", &stats->lock_wait);
+    stats_print_histogram(file, "lock hold", &stats->lock_hold);
+    stats_print_histogram(file, "round trip", &stats->round_trip);
+}
+
+// Складывает полосы счетчиков и печатает сумму.
+static inline void stats_print_stripes(FILE *file, const hotel_stats_stripes_t *stats) {
+    hotel_stats_t total;
+    stats_sum(stats, &total);
+    stats_print(file, &total);
+}
+
+#endif //HW2_COMMON_STATS_H
@@ -0,0 +1,64 @@
+#ifndef HW2_COMMON_SYSV_LOCK_H
+#define HW2_COMMON_SYSV_LOCK_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/sem.h>
+
+// Блокировка на семафоре System V: значение 1 - свободна, 0 - захвачена.
+// Захват и освобождение - это одна атомарная операция semop, поэтому два процесса не могут захватить блокировку
+// одновременно. Флаг SEM_UNDO заставляет ядро вернуть значение, если процесс завершится, не освободив блокировку,
+// так что упавший клиент не оставит отель заблокированным.
+// Набор из нескольких семафоров - это несколько независимых блокировок, по одной на номер семафора в наборе.
+
+// Изменяет значение семафора sem_num на delta. Ожидание, прерванное сигналом, повторяется. Любая другая ошибка
+// (например, семафор уже удален) завершает процесс: продолжать без блокировки значило бы бронировать номера
+// вперемешку.
+static inline void sysv_lock_change(int sem_id, unsigned short sem_num, short delta) {
+    struct sembuf sem_op;
+    sem_op.sem_num = sem_num;
+    sem_op.sem_op = delta;
+    sem_op.sem_flg = SEM_UNDO;
+
+    while (semop(sem_id, &sem_op, 1) == -1) {
+        if (errno != EINTR) {
+            perror("sysv_lock: semop");
+            abort();
+        }
+    }
+}
+
+// Делает блокировку свободной. Вызывается создателем семафора до того, как им начнут пользоваться другие процессы.
+static inline void sysv_lock_init(int sem_id) {
+    semctl(sem_id, 0, SETVAL, 1);
+}
+
+// Делает свободными все count блокировок набора.
+static inline void sysv_lock_init_set(int sem_id, int count) {
+    for (int i = 0; i < count; ++i) {
+        semctl(sem_id, i, SETVAL, 1);
+    }
+}
+
+// Захватывает блокировку, ожидая ее освобождения.
+static inline void sysv_lock(int sem_id) {
+    sysv_lock_change(sem_id, 0, -1);
+}
+
+// Освобождает блокировку.
+static inline void sysv_unlock(int sem_id) {
+    sysv_lock_change(sem_id, 0, 1);
+}
+
+// Захватывает блокировку sem_num из набора.
+static inline void sysv_lock_at(int sem_id, unsigned short sem_num) {
+    sysv_lock_change(sem_id, sem_num, -1);
+}
+
+// Освобождает блокировку sem_num из набора.
+static inline void sysv_unlock_at(int sem_id, unsigned short sem_num) {
+    sysv_lock_change(sem_id, sem_num, 1);
+}
+
+#endif //HW2_COMMON_SYSV_LOCK_H
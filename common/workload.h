@@ -0,0 +1,160 @@
+#ifndef HW2_COMMON_WORKLOAD_H
+#define HW2_COMMON_WORKLOAD_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "clients.h"
+
+// Распределение сроков аренды в синтетической трассе.
+typedef enum {
+    rent_fixed,
+    rent_uniform,
+    rent_exponential,
+    rent_pareto
+} rent_distribution;
+
+// Параметры синтетической трассы клиентов.
+typedef struct {
+    int clients_count;
+    // Доля клиентов с полом 1.
+    double women_share;
+    rent_distribution rent;
+    // fixed: rent_a; uniform: [rent_a, rent_b]; exp: среднее rent_a; pareto: минимум rent_a и показатель rent_b.
+    double rent_a;
+    double rent_b;
+    // Средняя частота прибытия клиентов в секунду (0 - все приходят сразу) и средний размер группы,
+    // приходящей одновременно.
+    double arrival_rate;
+    double burst_size;
+    uint64_t seed;
+} workload_config_t;
+
+// Генератор xorshift64*: у одинакового seed одинаковая трасса на любой платформе.
+static inline uint64_t workload_next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+// Возвращает случайное число из [0, 1).
+static inline double workload_next_uniform(uint64_t *state) {
+    return (double) (workload_next_random(state) >> 11) / 9007199254740992.0;
+}
+
+// Возвращает случайное число из экспоненциального распределения со средним mean.
+static inline double workload_next_exponential(uint64_t *state, double mean) {
+    return -log(1.0 - workload_next_uniform(state)) * mean;
+}
+
+// Заполняет параметры трассы по-умолчанию: клиентов поровну каждого пола, нулевые сроки, все приходят сразу.
+static inline void workload_config_init(workload_config_t *config) {
+    memset(config, 0, sizeof(workload_config_t));
+    config->clients_count = 1000;
+    config->women_share = 0.5;
+    config->burst_size = 1;
+    config->seed = 42;
+}
+
+// Разбирает описание распределения сроков: "T", "uniform:MIN:MAX", "exp:MEAN" или "pareto:MIN:ALPHA".
+// Возвращает -1, если описание не распознано.
+static inline int workload_parse_rent(workload_config_t *config, const char *value) {
+    if (sscanf(value, "uniform:%lf:%lf", &config->rent_a, &config->rent_b) == 2) {
+        config->rent = rent_uniform;
+    } else if (sscanf(value, "exp:%lf", &config->rent_a) == 1) {
+        config->rent = rent_exponential;
+    } else if (sscanf(value, "pareto:%lf:%lf", &config->rent_a, &config->rent_b) == 2 && config->rent_b > 0) {
+        config->rent = rent_pareto;
+    } else if (sscanf(value, "%lf", &config->rent_a) == 1) {
+        config->rent = rent_fixed;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Разбирает аргумент трассы вида name=value. Возвращает 0, если аргумент относится к трассе, и -1 иначе.
+static inline int workload_parse_argument(workload_config_t *config, const char *argument) {
+    if (strncmp(argument, "clients=", 8) == 0) {
+        config->clients_count = atoi(argument + 8);
+    } else if (strncmp(argument, "women=", 6) == 0) {
+        config->women_share = atof(argument + 6);
+    } else if (strncmp(argument, "rent=", 5) == 0) {
+        return workload_parse_rent(config, argument + 5);
+    } else if (strncmp(argument, "rate=", 5) == 0) {
+        config->arrival_rate = atof(argument + 5);
+    } else if (strncmp(argument, "burst=", 6) == 0) {
+        config->burst_size = atof(argument + 6) >= 1 ? atof(argument + 6) : 1;
+    } else if (strncmp(argument, "seed=", 5) == 0) {
+        config->seed = strtoull(argument + 5, NULL, 10);
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Возвращает срок аренды очередного клиента в целых секундах (дробная часть отбрасывается).
+static inline int32_t workload_next_rent_time(const workload_config_t *config, uint64_t *state) {
+    double rent_time = config->rent_a;
+
+    if (config->rent == rent_uniform) {
+        rent_time = config->rent_a + workload_next_uniform(state) * (config->rent_b - config->rent_a + 1);
+    } else if (config->rent == rent_exponential) {
+        rent_time = workload_next_exponential(state, config->rent_a);
+    } else if (config->rent == rent_pareto) {
+        // Тяжелый хвост: большинство сроков близки к минимуму, но изредка встречаются очень долгие.
+        rent_time = config->rent_a / pow(1.0 - workload_next_uniform(state), 1.0 / config->rent_b);
+    }
+
+    return rent_time < INT32_MAX ? (int32_t) rent_time : INT32_MAX;
+}
+
+// Генерирует трассу клиентов. Клиенты приходят группами: между группами проходит экспоненциальное время,
+// а размер группы распределен геометрически со средним burst_size, так что в среднем клиенты приходят
+// с частотой arrival_rate. Моменты прибытия записываются, только если частота задана.
+// Возвращает -1, если не хватило памяти.
+static inline int workload_generate(const workload_config_t *config, clients_trace_t *trace) {
+    uint64_t state = config->seed != 0 ? config->seed : 1;
+    double arrival_at = 0;
+    int burst_left = 0;
+
+    memset(trace, 0, sizeof(clients_trace_t));
+    trace->owns_columns = 1;
+    trace->rent_time_width = sizeof(int32_t);
+    if (clients_reserve(trace, (size_t) config->clients_count) == -1 ||
+        (config->arrival_rate > 0 && clients_reserve_arrivals(trace, (size_t) config->clients_count) == -1)) {
+        clients_free(trace);
+        return -1;
+    }
+
+    for (int i = 0; i < config->clients_count; ++i) {
+        ((int32_t *) trace->ids)[i] = i + 1;
+        ((uint8_t *) trace->genders)[i / 8] |=
+                (uint8_t) ((workload_next_uniform(&state) < config->women_share) << (i % 8));
+        ((int32_t *) trace->rent_times)[i] = workload_next_rent_time(config, &state);
+
+        if (trace->arrivals != NULL) {
+            if (burst_left == 0) {
+                arrival_at += workload_next_exponential(&state, 1000.0 * config->burst_size / config->arrival_rate);
+                // Целая часть экспоненциальной величины распределена геометрически: среднее подобрано так,
+                // чтобы средний размер группы был ровно burst_size.
+                double mean = config->burst_size > 1 ? 1.0 / log(config->burst_size / (config->burst_size - 1)) : 0;
+                burst_left = 1 + (int) workload_next_exponential(&state, mean);
+            }
+
+            burst_left--;
+            ((uint32_t *) trace->arrivals)[i] = arrival_at < UINT32_MAX ? (uint32_t) arrival_at : UINT32_MAX;
+        }
+
+        trace->count++;
+    }
+
+    return 0;
+}
+
+#endif //HW2_COMMON_WORKLOAD_H
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../common/clients.h"
+
+// Записывает трассу в текстовом формате "id gender rent_time".
+static int save_text(const clients_trace_t *trace, const char *path) {
+    FILE *file = fopen(path, "w");
+    client_record_t record;
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < trace->count; ++i) {
+        clients_get(trace, i, &record);
+        fprintf(file, "%d %d %d\n", record.id, record.gender, record.rent_time);
+    }
+
+    return fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+    // Запуск: ./clients_convert clients.txt clients.bin - в двоичный формат,
+    //         ./clients_convert clients.bin clients.txt text - обратно в текстовый.
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s input output [text]\n", argv[0]);
+        return 1;
+    }
+
+    clients_trace_t trace;
+    if (clients_load(&trace, argv[1]) == -1) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    int result;
+    if (argc > 3 && strcmp(argv[3], "text") == 0) {
+        result = save_text(&trace, argv[2]);
+    } else {
+        // Сроки аренды записываются самым узким столбцом, в который они помещаются.
+        result = clients_save_binary(&trace, argv[2], clients_min_rent_time_width(&trace));
+    }
+
+    if (result == -1) {
+        perror(argv[2]);
+    } else {
+        printf("%d clients written to %s.\n", trace.count, argv[2]);
+    }
+
+    clients_free(&trace);
+    return result == -1 ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../common/workload.h"
+
+int main(int argc, char *argv[]) {
+    // Запуск: ./clients_generate output [text] [clients=N] [women=P] [rent=...] [rate=R] [burst=B] [seed=N]
+    // Сроки аренды: rent=T, rent=uniform:MIN:MAX, rent=exp:MEAN или rent=pareto:MIN:ALPHA (в секундах).
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s output [text] [clients=N] [women=P] [rent=...] [rate=R] [burst=B] [seed=N]\n",
+                argv[0]);
+        return 1;
+    }
+
+    workload_config_t config;
+    int as_text = 0;
+    workload_config_init(&config);
+
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "text") == 0) {
+            as_text = 1;
+        } else if (workload_parse_argument(&config, argv[i]) == -1) {
+            fprintf(stderr, "unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    clients_trace_t trace;
+    if (config.clients_count < 0 || workload_generate(&config, &trace) == -1) {
+        perror("workload_generate");
+        return 1;
+    }
+
+    int result;
+    if (as_text) {
+        // В текстовом формате нет столбца моментов прибытия, поэтому он не сохраняется.
+        FILE *file = fopen(argv[1], "w");
+        client_record_t record;
+        result = file != NULL ? 0 : -1;
+
+        for (int i = 0; file != NULL && i < trace.count; ++i) {
+            clients_get(&trace, i, &record);
+            fprintf(file, "%d %d %d\n", record.id, record.gender, record.rent_time);
+        }
+
+        if (file != NULL) {
+            result = fclose(file);
+        }
+    } else {
+        result = clients_save_binary(&trace, argv[1], clients_min_rent_time_width(&trace));
+    }
+
+    if (result == -1) {
+        perror(argv[1]);
+    } else {
+        printf("%d clients written to %s.\n", trace.count, argv[1]);
+    }
+
+    clients_free(&trace);
+    return result == -1 ? 1 : 0;
+}
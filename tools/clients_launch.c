@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/clients.h"
+
+int main(int argc, char *argv[]) {
+    // Запуск: ./clients_launch ./client.out clients.bin [jobs=N]
+    // Для каждой записи трассы запускается "./client.out id gender rent_time", одновременно - не больше N клиентов.
+    // Если в трассе есть моменты прибытия, клиент запускается не раньше своего момента.
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s client trace [jobs=N]\n", argv[0]);
+        return 1;
+    }
+
+    int jobs = 256;
+    if (argc > 3 && strncmp(argv[3], "jobs=", 5) == 0) {
+        jobs = atoi(argv[3] + 5);
+        jobs = jobs > 0 ? jobs : 1;
+    }
+
+    clients_trace_t trace;
+    if (clients_load(&trace, argv[2]) == -1) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    int running = 0;
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    for (int i = 0; i < trace.count; ++i) {
+        client_record_t record;
+        clients_get(&trace, i, &record);
+
+        // Ждем завершения какого-нибудь клиента, если запущено уже jobs процессов. Код возврата не проверяется:
+        // клиенты всегда завершаются через free_resources с кодом 1.
+        if (running == jobs) {
+            wait(NULL);
+            running--;
+        }
+
+        if (trace.arrivals != NULL) {
+            uint32_t arrival = clients_arrival(&trace, i);
+            struct timespec arrive_at = started_at;
+            arrive_at.tv_sec += arrival / 1000;
+            arrive_at.tv_nsec += (long) (arrival % 1000) * 1000000;
+            if (arrive_at.tv_nsec >= 1000000000) {
+                arrive_at.tv_sec++;
+                arrive_at.tv_nsec -= 1000000000;
+            }
+
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &arrive_at, NULL);
+        }
+
+        char id[16], gender[16], rent_time[16];
+        snprintf(id, sizeof(id), "%d", record.id);
+        snprintf(gender, sizeof(gender), "%d", record.gender);
+        snprintf(rent_time, sizeof(rent_time), "%d", record.rent_time);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl(argv[1], argv[1], id, gender, rent_time, (char *) NULL);
+            perror(argv[1]);
+            _exit(127);
+        } else if (pid > 0) {
+            running++;
+        }
+    }
+
+    while (running > 0) {
+        wait(NULL);
+        running--;
+    }
+
+    clients_free(&trace);
+    return 0;
+}
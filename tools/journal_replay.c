@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/journal.h"
+
+// Число событий каждого вида за интервал отчета.
+typedef struct {
+    uint64_t booked;
+    uint64_t rejected;
+    uint64_t released;
+} interval_counts_t;
+
+// Печатает заполненность отеля на конец интервала, начавшегося через offset_ms после первой записи журнала.
+static void print_occupancy(const hotel_engine_t *engine, int64_t offset_ms, const interval_counts_t *counts) {
+    const rooms_view_t *view = &engine->view;
+    int free_single = rooms_vacancy_get(view, 0, freed);
+    int free_double = rooms_vacancy_get(view, 1, freed);
+    int half_double = rooms_vacancy_get(view, 1, busied_by_man) + rooms_vacancy_get(view, 1, busied_by_woman);
+    int places = view->single_rooms_count + view->double_rooms_count * 2;
+
+    printf("%10.1f %8d %7.1f%% %8d %8d %8d %10llu %10llu %10llu\n", (double) offset_ms / 1000.0,
+           engine->bookings_count, places > 0 ? 100.0 * engine->bookings_count / places : 0.0,
+           view->single_rooms_count - free_single, view->double_rooms_count - free_double - half_double, half_double,
+           (unsigned long long) counts->booked, (unsigned long long) counts->rejected,
+           (unsigned long long) counts->released);
+}
+
+int main(int argc, char *argv[]) {
+    // Запуск: ./journal_replay hotel.journal [interval=MS]
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s journal [interval=MS]\n", argv[0]);
+        return 1;
+    }
+
+    int64_t interval_ms = 1000;
+    for (int i = 2; i < argc; ++i) {
+        if (strncmp(argv[i], "interval=", 9) == 0 && atoll(argv[i] + 9) > 0) {
+            interval_ms = atoll(argv[i] + 9);
+        } else {
+            fprintf(stderr, "unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    journal_t journal;
+    if (journal_open_readonly(&journal, argv[1]) == -1) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    // Состояние номеров восстанавливает тот же распределитель, что работает в отеле.
+    rooms_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.single_rooms_count = journal.header->single_rooms_count;
+    config.double_rooms_count = journal.header->double_rooms_count;
+    config.shards_count = 1;
+
+    hotel_engine_t engine;
+    if (hotel_engine_init(&engine, &config) == -1) {
+        perror("hotel_engine_init");
+        journal_close(&journal);
+        return 1;
+    }
+
+    uint64_t count = journal.header->records_count;
+    const journal_record_t *records = journal_records(&journal);
+    int64_t started_at = count > 0 ? records[0].time_ms : 0;
+    int64_t interval_end = started_at + interval_ms;
+    interval_counts_t counts = {0, 0, 0};
+    // Есть ли в текущем интервале события, которые еще не вошли в отчет.
+    int interval_pending = 0;
+    uint64_t errors = 0;
+
+    printf("single rooms = %d, double rooms = %d, records = %llu.\n", config.single_rooms_count,
+           config.double_rooms_count, (unsigned long long) count);
+    printf("%10s %8s %8s %8s %8s %8s %10s %10s %10s\n", "time, s", "guests", "places", "single", "double", "half",
+           "booked", "rejected", "released");
+
+    for (uint64_t i = 0; i < count; ++i) {
+        const journal_record_t *record = &records[i];
+
+        // Отчет печатается за каждый интервал, в котором что-то произошло. Пустые интервалы пропускаются: заполненность
+        // в них та же, что в конце предыдущего.
+        if (record->time_ms >= interval_end) {
+            if (interval_pending) {
+                print_occupancy(&engine, interval_end - started_at, &counts);
+            }
+
+            memset(&counts, 0, sizeof(counts));
+            interval_pending = 0;
+            interval_end += (record->time_ms - interval_end) / interval_ms * interval_ms + interval_ms;
+        }
+
+        // Выезды заново не планируются: журнал сам содержит выселения по окончании аренды.
+        if (journal_apply(&engine, record, -1, 0) == -1) {
+            fprintf(stderr, "record %llu: inconsistent %u event for client %d, skipped.\n", (unsigned long long) i,
+                    record->event, record->client_id);
+            errors++;
+            continue;
+        }
+
+        interval_pending = 1;
+        counts.booked += record->event == journal_book;
+        counts.rejected += record->event == journal_reject;
+        counts.released += record->event == journal_release || record->event == journal_checkout;
+    }
+
+    // Последний интервал печатается так же, как остальные, и только если после предыдущего отчета что-то произошло.
+    if (interval_pending) {
+        print_occupancy(&engine, interval_end - started_at, &counts);
+    }
+
+    printf("guests at the end = %d, inconsistent records = %llu.\n", engine.bookings_count,
+           (unsigned long long) errors);
+
+    hotel_engine_free(&engine);
+    journal_close(&journal);
+    return errors == 0 ? 0 : 1;
+}